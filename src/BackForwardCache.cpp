@@ -0,0 +1,96 @@
+#include "BackForwardCache.hpp"
+#include "../utils/BrocContainer.hpp"
+#include "WebView.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+CachedPage::~CachedPage()
+{
+	// the document refers to its container, so it has to go first
+	document = nullptr;
+	delete container;
+	for (auto child : children)
+		delete child;
+}
+
+BackForwardCache& BackForwardCache::getInstance()
+{
+	static BackForwardCache instance;
+	return instance;
+}
+
+void BackForwardCache::store(std::unique_ptr<CachedPage> page)
+{
+	// an older copy of the same page is stale now
+	take(page->owner, page->url);
+
+	totalBytes += page->size;
+	std::cout << "[BackForwardCache] Keeping " << page->url << " ("
+			  << page->size / 1024 << "KB)" << std::endl;
+
+	pages.push_back(std::move(page));
+	evict();
+}
+
+std::unique_ptr<CachedPage> BackForwardCache::take(WebView* owner,
+	const std::string& url)
+{
+	auto it = std::find_if(pages.begin(), pages.end(),
+		[&](const auto& page)
+		{ return page->owner == owner && page->url == url; });
+	if (it == pages.end())
+		return nullptr;
+
+	auto page = std::move(*it);
+	totalBytes -= page->size;
+	pages.erase(it);
+	return page;
+}
+
+void BackForwardCache::removeAll(WebView* owner)
+{
+	for (auto it = pages.begin(); it != pages.end();)
+	{
+		auto next = std::next(it);
+		if ((*it)->owner == owner)
+			erase(it);
+		it = next;
+	}
+}
+
+void BackForwardCache::erase(std::list<std::unique_ptr<CachedPage>>::iterator it)
+{
+	totalBytes -= (*it)->size;
+	pages.erase(it);
+}
+
+void BackForwardCache::evict()
+{
+	// pages are kept in the order they were stored, so the front is the oldest
+
+	// keep each tab to its own handful of pages
+	std::map<WebView*, int> perTab;
+	for (auto& page : pages)
+		perTab[page->owner]++;
+
+	for (auto it = pages.begin(); it != pages.end();)
+	{
+		auto next = std::next(it);
+		if (perTab[(*it)->owner] > BFCACHE_MAX_PAGES_PER_TAB)
+		{
+			perTab[(*it)->owner]--;
+			std::cout << "[BackForwardCache] Evicting " << (*it)->url << std::endl;
+			erase(it);
+		}
+		it = next;
+	}
+
+	// then drop the oldest pages across all tabs until they fit the budget
+	while (!pages.empty() && totalBytes > BFCACHE_MEMORY_BUDGET)
+	{
+		std::cout << "[BackForwardCache] Evicting " << pages.front()->url << std::endl;
+		erase(pages.begin());
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../libs/chesto/src/Element.hpp"
+#include <litehtml.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+class BrocContainer;
+class WebView;
+
+// how many pages each tab keeps alive for back/forward
+#define BFCACHE_MAX_PAGES_PER_TAB 4
+// estimated memory all tabs' cached pages may use together (~24MB)
+#define BFCACHE_MEMORY_BUDGET 0x1800000
+// rough cost of a parsed DOM and its layout per byte of HTML source
+#define BFCACHE_DOM_BYTES_PER_SOURCE_BYTE 8
+
+// A fully loaded page taken out of its WebView, ready to be put back as-is
+struct CachedPage
+{
+	~CachedPage();
+
+	WebView* owner = nullptr;
+	std::string url;
+
+	litehtml::document::ptr document;
+	BrocContainer* container = nullptr;
+	std::vector<Element*> children; // images and anything else drawn on top
+
+	std::string contents;
+	std::string windowTitle;
+	CST_Color themeColor;
+	int scrollY = 0;
+
+	size_t size = 0; // estimated bytes kept alive by this entry
+};
+
+// Keeps the last few pages of every tab parsed, laid out and with their images
+// decoded, so going back or forward is instant and lands where the user left
+// off. Pages are evicted oldest first to keep all tabs within one budget.
+// Main thread only.
+class BackForwardCache
+{
+public:
+	static BackForwardCache& getInstance();
+
+	// takes ownership of the page, replacing any older copy of the same url
+	void store(std::unique_ptr<CachedPage> page);
+
+	// hands back (and forgets) the given tab's copy of url, if there is one
+	std::unique_ptr<CachedPage> take(WebView* owner, const std::string& url);
+
+	// drop every page of a tab, eg. when it's closed
+	void removeAll(WebView* owner);
+
+	size_t totalBytes = 0;
+
+private:
+	BackForwardCache() = default;
+
+	std::list<std::unique_ptr<CachedPage>> pages; // oldest first
+
+	void evict();
+	void erase(std::list<std::unique_ptr<CachedPage>>::iterator it);
+};
@@ -1,4 +1,9 @@
 #include "MainDisplay.hpp"
+#include "../utils/ConnectionPool.hpp"
+#include "../utils/DownloadManager.hpp"
+#include "../utils/HttpCache.hpp"
+#include "../utils/NetworkWorker.hpp"
+#include "../utils/RequestScheduler.hpp"
 #include "../utils/Utils.hpp"
 #include "JSEngine.hpp"
 #include "URLBar.hpp"
@@ -41,6 +46,16 @@ MainDisplay::MainDisplay()
 	mkdir("./data/cache", 0777);
 	mkdir("./data/domains", 0777);
 
+	// large downloads spill into here, anything left over is from a crash
+	mkdir(NETWORK_SPILL_DIRECTORY, 0777);
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(NETWORK_SPILL_DIRECTORY, error))
+		std::filesystem::remove(entry.path(), error);
+
+	// and carry on with any downloads that were interrupted last time
+	mkdir(DOWNLOAD_DIRECTORY, 0777);
+	DownloadManager::getInstance().resumeAll();
+
 	// parse the favorites from JSON using JSEngine directly
 	std::string favoritesContent = readFile("./data/favorites.json");
 	if (!favoritesContent.empty())
@@ -73,8 +88,22 @@ MainDisplay::MainDisplay()
 
 bool MainDisplay::process(InputEvents* event)
 {
+	// start whatever queued fetches matter most now that last frame's layout
+	// (and scroll position) has had a chance to re-prioritize them
+	auto& scheduler = RequestScheduler::getInstance();
+	scheduler.pump();
+
+	// hand any finished network responses back to their views (even while a
+	// subscreen is up, so background tabs keep loading)
+	bool networkUpdated = NetworkWorker::getInstance().drain() > 0;
+	DownloadManager::getInstance().update();
+
+	// keep redrawing while loads are in flight, so the progress bar moves
+	networkUpdated |= NetworkWorker::getInstance().hasPendingRequests();
+	networkUpdated |= scheduler.hasQueued();
+
 	if (RootDisplay::subscreen)
-		return RootDisplay::subscreen->process(event);
+		return RootDisplay::subscreen->process(event) || networkUpdated;
 
 	bool ret = Element::process(event);
 	if (ret)
@@ -85,6 +114,8 @@ bool MainDisplay::process(InputEvents* event)
 		cleanPrivateFiles();
 		writeFile("./data/views.json", fullSessionSummary());
 		writeFile("./data/favorites.json", favoritesSummary());
+		ConnectionPool::getInstance().saveTlsSessions();
+		DownloadManager::getInstance().saveAll();
 		requestQuit();
 	};
 	// keep processing child elements
@@ -112,7 +143,7 @@ bool MainDisplay::process(InputEvents* event)
 		return true;
 	}
 
-	return false;
+	return networkUpdated;
 }
 
 void MainDisplay::render(Element* parent)
@@ -235,6 +266,9 @@ std::string MainDisplay::favoritesSummary()
 
 void MainDisplay::cleanPrivateFiles()
 {
+	// private pages were only ever cached in memory, drop them too
+	HttpCache::getInstance(true).clear();
+
 	struct stat info;
 	std::filesystem::path path = "./data/pviews";
 	if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
@@ -0,0 +1,136 @@
+#include "NetworkImage.hpp"
+#include "../utils/ImageProbe.hpp"
+#include "../utils/NetworkWorker.hpp"
+#include "../utils/Utils.hpp"
+
+NetworkImage::NetworkImage(std::string url, bool isPrivate, const void* owner)
+	: isPrivate(isPrivate)
+	, owner(owner)
+{
+	this->url = url;
+}
+
+void NetworkImage::load(FetchPriority priority)
+{
+	if (requested())
+		return;
+
+	fetch = RequestScheduler::getInstance().fetch(url, isPrivate, priority, owner,
+		[this](NetRequest& response)
+		{
+			fetch = nullptr;
+			if (!response.fromCache)
+			{
+				bytesOnWire = response.bytesOnWire;
+				bytesDecoded = response.bytesReceived;
+			}
+
+			if (!response.success || response.httpCode >= 400 || !loadFromResponse(response))
+				loadFallback();
+
+			loaded = true;
+			if (onLoad)
+				onLoad(this);
+		},
+		[this](NetRequest& response)
+		{ probeSize(response.received); });
+}
+
+void NetworkImage::probeSize(const std::string& received)
+{
+	if (!probing)
+		return;
+
+	int width = 0, height = 0;
+	auto result = probeImageSize(received, width, height);
+	if (result == PROBE_NEED_MORE)
+		return;
+
+	// found it, or never will, either way the decode settles it later
+	probing = false;
+	if (result == PROBE_FOUND)
+		setNaturalSize(width, height);
+}
+
+void NetworkImage::setNaturalSize(int width, int height)
+{
+	if (width == naturalWidth && height == naturalHeight)
+		return;
+
+	naturalWidth = width;
+	naturalHeight = height;
+	if (onSize)
+		onSize(this);
+}
+
+NetworkImage::~NetworkImage()
+{
+	// don't let the callback fire into a deleted image
+	RequestScheduler::getInstance().cancel(fetch);
+}
+
+void NetworkImage::setPriority(FetchPriority priority)
+{
+	RequestScheduler::getInstance().setPriority(fetch, priority);
+}
+
+void NetworkImage::loadDownloaded(const std::string& bytes, const std::string& path)
+{
+	if (!(path.empty() ? loadFromBytes(bytes) : loadFromFile(path)))
+		loadFallback();
+
+	loaded = true;
+	if (onLoad)
+		onLoad(this);
+}
+
+bool NetworkImage::loadFromResponse(NetRequest& response)
+{
+	// big images went to disk rather than into memory
+	if (response.spilled != nullptr)
+		return loadFromFile(response.spilled->path);
+	return loadFromBytes(response.body);
+}
+
+bool NetworkImage::loadFromBytes(const std::string& bytes)
+{
+	if (bytes.empty())
+		return false;
+
+	return loadFromDecoded(IMG_Load_RW(SDL_RWFromMem((void*)bytes.c_str(), bytes.size()), 1));
+}
+
+bool NetworkImage::loadFromFile(const std::string& path)
+{
+	return loadFromDecoded(IMG_Load(path.c_str()));
+}
+
+bool NetworkImage::loadFromDecoded(CST_Surface* surface)
+{
+	if (surface == NULL)
+		return false;
+
+	loadFromSurfaceSaveToCache(url, surface);
+
+	// update size!
+	this->width = surface->w;
+	this->height = surface->h;
+	setNaturalSize(surface->w, surface->h);
+
+	CST_FreeSurface(surface);
+	return true;
+}
+
+void NetworkImage::loadFallback()
+{
+	// could not load image, fallback
+	CST_Surface* surface = IMG_Load(RAMFS "res/redx.png");
+	if (surface == NULL)
+		return;
+
+	loadFromSurfaceSaveToCache(RAMFS "res/redx.png", surface);
+	this->width = surface->w;
+	this->height = surface->h;
+	setNaturalSize(surface->w, surface->h);
+	CST_FreeSurface(surface);
+}
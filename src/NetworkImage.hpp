@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../libs/chesto/src/Texture.hpp"
+#include "../utils/RequestScheduler.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+
+class NetworkImage : public Texture
+{
+public:
+	/// Creates a new image that downloads itself through the request scheduler
+	/// (and HTTP cache) once load() is called, falling back to a red X if it
+	/// can't be loaded. The owner is whoever should be able to cancel it along
+	/// with the page.
+	NetworkImage(std::string url, bool isPrivate, const void* owner = nullptr);
+	~NetworkImage();
+
+	std::string url;
+	bool loaded = false;
+
+	/// Queue the download (does nothing if it was already started, but will
+	/// start over if the page's fetches were cancelled in the meantime)
+	void load(FetchPriority priority);
+	bool requested() const { return (fetch != nullptr && !fetch->cancelled) || loaded; }
+
+	// what the download cost, both zero if it came from the cache
+	size_t bytesOnWire = 0;
+	size_t bytesDecoded = 0;
+
+	/// The image's own size, known as soon as its header has streamed in (well
+	/// before it's decoded), 0 until then
+	int naturalWidth = 0;
+	int naturalHeight = 0;
+
+	/// Invoked on the main thread once the image (or its fallback) is ready
+	std::function<void(NetworkImage*)> onLoad;
+
+	/// Invoked on the main thread whenever the natural size becomes known or
+	/// changes, so the page can be laid out again
+	std::function<void(NetworkImage*)> onSize;
+
+	/// Move the download up or down the queue, eg. as it scrolls into view
+	void setPriority(FetchPriority priority);
+
+	/// Decode an image that was already downloaded some other way (eg. as the
+	/// page itself), from memory or from the file it was spilled to
+	void loadDownloaded(const std::string& bytes, const std::string& path = "");
+
+private:
+	bool isPrivate;
+	const void* owner;
+	std::shared_ptr<ScheduledFetch> fetch;
+	bool probing = true;
+
+	void probeSize(const std::string& received);
+	void setNaturalSize(int width, int height);
+	bool loadFromBytes(const std::string& bytes);
+	bool loadFromFile(const std::string& path);
+	bool loadFromDecoded(CST_Surface* surface);
+	bool loadFromResponse(NetRequest& response);
+	void loadFallback();
+};
@@ -103,6 +103,7 @@ void URLBar::createURLBarElements()
           webView->url = webView->history[webView->historyIndex];
           // printf("Going back to %s\n", webView->url.c_str());
           resetBar();
+          webView->historyNavigation = true;
           webView->needsLoad = true;
 
           return true; })->constrain(ALIGN_LEFT, sidePadding - 1));
@@ -121,6 +122,7 @@ void URLBar::createURLBarElements()
                     webView->url = webView->history[webView->historyIndex];
                     // printf("Going forward to %s\n", webView->url.c_str());
                     resetBar();
+                    webView->historyNavigation = true;
                     webView->needsLoad = true;
                     return true; })->constrain(ALIGN_LEFT, sidePadding / 3 + btnAndPadding);
 	forwardButton->hidden = true;
@@ -190,7 +192,12 @@ void URLBar::createURLBarElements()
 	child(makeURLBarButton("refresh", [this]()
 		{
           auto webView = this->webView;
-          webView->needsLoad = true;
+          // while a page is loading, this acts as a stop button instead
+          if (webView->isLoading()) {
+            webView->stopLoading();
+            return true;
+          }
+          webView->reloadPage();
           return true; })->constrain(ALIGN_RIGHT, sidePadding / 3 + btnAndPadding * 2 + 10));
 }
 
@@ -392,6 +399,16 @@ void URLBar::render(Element* parent)
 			height / 2 + innerHeight / 2, 15, 0x66, 0x7c, 0x89, 0x90);
 	}
 
+	// thin progress bar along the bottom of the bar while a page is loading
+	if (webView != NULL && webView->isLoading())
+	{
+		int barHeight = 3;
+		CST_Rect progressRect = { x, y + height - barHeight,
+			(int)(width * fmax(0.05, webView->loadProgress())), barHeight };
+		CST_SetDrawColorRGBA(RootDisplay::renderer, 0x3c, 0x8d, 0xf0, 0xff);
+		CST_FillRect(RootDisplay::renderer, &progressRect);
+	}
+
 	Element::render(parent);
 }
 
@@ -2,6 +2,16 @@
 #include "../libs/chesto/src/ImageElement.hpp"
 #include "../libs/chesto/src/NetImageElement.hpp"
 #include "../utils/BrocContainer.hpp"
+#include "../utils/DownloadManager.hpp"
+#include "../utils/FontCache.hpp"
+#include "../utils/HstsStore.hpp"
+#include "../utils/NetworkArchive.hpp"
+#include "../utils/NetworkWorker.hpp"
+#include "../utils/RedirectCache.hpp"
+#include "../utils/RequestScheduler.hpp"
+#include "../utils/StylesheetCache.hpp"
+#include "../utils/TextRenderer.hpp"
+#include "../utils/TileCache.hpp"
 #include "../utils/UIUtils.hpp"
 #include "../utils/Utils.hpp"
 #include "JSEngine.hpp"
@@ -10,6 +20,7 @@
 #include "URLBar.hpp"
 #include "VirtualDOM.hpp"
 #include "AlertManager.hpp"
+#include "BackForwardCache.hpp"
 
 #include <fstream>
 #include <iostream>
@@ -42,6 +53,10 @@ WebView::WebView()
 }
 
 WebView::~WebView() {
+	stopLoading();
+	cancelLinkPrefetch();
+	logTransferStats();
+	BackForwardCache::getInstance().removeAll(this);
 	cleanupJavaScript();
 	// clean up the alert, which never actually got added to the render tree
 	delete alert;
@@ -58,14 +73,24 @@ bool WebView::process(InputEvents* e)
 	}
 	if (needsLoad)
 	{
-		this->downloadPage();
 		needsLoad = false;
-		auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
+		this->downloadPage();
 		return true;
 	}
 
+	if (this->m_doc == nullptr)
+	{
+		// still waiting on the first page to arrive, nothing to hit-test yet
+		return ListElement::processUpDown(e) || ListElement::process(e);
+	}
+
 	litehtml::position::vector redraw_boxes;
 
+	// a link the cursor has been resting on is likely to be clicked next
+	if (prefetchLinks && !hoveredLink.empty() && hoveredLink != prefetchedLink
+		&& std::chrono::steady_clock::now() - hoveredSince >= std::chrono::milliseconds(LINK_HOVER_PREFETCH_MS))
+		prefetchLink(hoveredLink);
+
 	if (e->pressed(A_BUTTON))
 	{
 		zoomLevel += 0.1;
@@ -92,6 +117,15 @@ bool WebView::process(InputEvents* e)
 		resp = this->m_doc->on_lbutton_down(-1 * this->x + e->xPos,
 			-1 * this->y + e->yPos, e->xPos,
 			e->yPos, redraw_boxes);
+
+		// there's usually a few hundred ms until the touch up, start on the
+		// link's page in the meantime
+		if (prefetchLinks && container != nullptr)
+		{
+			hoveredLink = container->linkAt(-1 * this->x + e->xPos, -1 * this->y + e->yPos);
+			hoveredSince = std::chrono::steady_clock::now();
+			prefetchLink(hoveredLink);
+		}
 		// printf("Got touch down with response %d\n", redraw_boxes.size());
 	}
 	else if (e->isTouchUp())
@@ -107,14 +141,39 @@ bool WebView::process(InputEvents* e)
 			-1 * this->y + e->yPos, e->xPos, e->yPos,
 			redraw_boxes);
 		nextLinkHref = "";
+
+		// moving onto another link (or off of one) restarts the hover clock,
+		// and drops whatever was prefetched for the old one
+		auto link = container != nullptr
+			? container->linkAt(-1 * this->x + e->xPos, -1 * this->y + e->yPos)
+			: "";
+		if (link != hoveredLink)
+		{
+			hoveredLink = link;
+			hoveredSince = std::chrono::steady_clock::now();
+			cancelLinkPrefetch();
+		}
 		// printf("Got touch drag with response %d\n", redraw_boxes.size());
 	}
 
 	// TODO: how to use this?
 	// bool litehtml::document::on_mouse_leave( position::vector& redraw_boxes );
 
+	// something changed its look (:hover, :active), draw it again
+	if (resp && container != nullptr)
+		container->displayListDirty = true;
+
 	// keep processing child elements
-	return ListElement::processUpDown(e) || ListElement::process(e) || resp;
+	bool childResp = ListElement::processUpDown(e) || ListElement::process(e);
+
+	// the tap didn't end up following the link (the overlays navigate above)
+	if (e->isTouchUp() && !needsLoad)
+	{
+		cancelLinkPrefetch();
+		hoveredLink.clear();
+	}
+
+	return childResp || resp;
 }
 
 void WebView::render(Element* parent)
@@ -122,10 +181,26 @@ void WebView::render(Element* parent)
 	if (hidden) {
 		return;
 	}
+	// stylesheets that arrived since the last frame, all applied in one go
+	if (needsRestyle && this->m_doc != nullptr)
+		restyleDocument();
+
 	if (needsRender && this->m_doc != nullptr)
 	{
+#ifdef LAYOUT_BENCHMARK
+		auto layoutStart = std::chrono::steady_clock::now();
+#endif
 		this->m_doc->render(this->width);
 		needsRender = false; // Mark as rendered
+		if (container != nullptr)
+		{
+			container->imagePrioritiesDirty = true;
+			container->displayListDirty = true;
+#ifdef LAYOUT_BENCHMARK
+			logLayoutStats(std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - layoutStart).count());
+#endif
+		}
 	}
 
 	if (prevContainer != nullptr)
@@ -135,16 +210,41 @@ void WebView::render(Element* parent)
 		prevContainer = nullptr;
 	}
 
-	if (container != nullptr)
+	if (container != nullptr && !blockedOnStylesheets())
 	{
-		litehtml::position posObj = litehtml::position(0, 0, this->width, this->height);
-		this->m_doc->draw((litehtml::uint_ptr)container, this->x, this->y, &posObj);
+		// the render tree is only walked once per layout, and what it drew is
+		// only rasterized again where it changed, scrolling just copies tiles
+		if (container->displayListDirty || container->displayList.document != m_doc.get())
+			container->recordDisplayList();
+		if (!TileCache::getInstance().composite(container->displayList, this->x, this->y, this->width, this->height))
+			container->displayList.replay(this->x, this->y, this->width, this->height);
+
+		if (awaitingFirstPaint)
+		{
+			awaitingFirstPaint = false;
+			firstPaintMs = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - loadStartTime)
+							   .count();
+			const char* source = restoredPage ? "back/forward cache"
+				: partialParses > 0			  ? "streamed"
+											  : "full document";
+			std::cout << "[WebView] Time to first paint: " << firstPaintMs << "ms ("
+					  << source << ")"
+					  << std::endl;
+		}
 
 		// After drawing (which populates render areas), create Chesto overlays for
 		// HTML elements
 		container->createChestoButtonsFromHTML();
 		container->createChestoLinksFromHTML();
 		container->createChestoEventListenersFromHTML();
+
+		// now that everything is positioned, fetch what's on screen first
+		container->prioritizeImages();
+
+		// and get ready for wherever the user goes next
+		if (!isLoading() && pendingStylesheets.empty())
+			container->warmLinkHosts();
 	}
 
 	// render the child elements (above whatever we just drew)
@@ -220,6 +320,18 @@ std::string sanitize_url(std::string url, bool isHTTPS = false)
 	return url;
 }
 
+// the url that loading url actually requests: cleaned up, then upgraded to
+// HTTPS and taken past any remembered redirects (which skips those round trips)
+static std::string navigationUrl(const std::string& url)
+{
+	auto sanitized = sanitize_url(url);
+	if (sanitized.find("http://") != 0 && sanitized.find("https://") != 0)
+		return sanitized;
+
+	auto& hsts = HstsStore::getInstance();
+	return hsts.upgrade(RedirectCache::getInstance().resolve(hsts.upgrade(sanitized)));
+}
+
 bool WebView::handle_http_code(int httpCode,
 	std::map<std::string, std::string> headerResp)
 {
@@ -240,12 +352,18 @@ bool WebView::handle_http_code(int httpCode,
 
 	std::cout << "Got non 200 HTTP code: " << httpCode << std::endl;
 
-	if (httpCode == 301 || httpCode == 302)
+	if (httpCode == 301 || httpCode == 302 || httpCode == 307 || httpCode == 308)
 	{
-		// redirect (TODO: cache?)
+		auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
+		auto from = this->url;
 		this->url = sanitize_url(headerResp["location"],
 			this->url.find("https://") != std::string::npos);
-		auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
+
+		// permanent ones go straight to the new url next time
+		bool permanent = httpCode == 301 || httpCode == 308;
+		if (permanent && !mainDisplay->privateMode && !hostFromUrl(this->url).empty())
+			RedirectCache::getInstance().record(from, this->url);
+
 		mainDisplay->urlBar->currentUrl = this->url;
 		mainDisplay->urlBar->updateInfo();
 		redirectCount++;
@@ -283,11 +401,48 @@ void WebView::downloadPage()
 {
 	auto mainDisplay = ((MainDisplay*)RootDisplay::mainDisplay);
 
+	// anything still loading for this view is now stale
+	stopLoading();
+
+	bool revalidate = revalidateNextLoad;
+	revalidateNextLoad = false;
+	bool fromHistory = historyNavigation;
+	historyNavigation = false;
+	restoredPage = false;
+
+	// start the clock for time-to-first-paint (redirects keep the original start)
+	if (redirectCount == 0)
+	{
+		loadStartTime = std::chrono::steady_clock::now();
+		logTransferStats();
+	}
+	awaitingFirstPaint = true;
+	partialParses = 0;
+	lastPartialSize = 0;
+	preloadScanner.reset();
+	preloadedImages = 0;
+	stylesheets.clear();
+	pendingStylesheets.clear();
+	needsRestyle = false;
+
 	// if it's a mailto: link, display a message to open the mail app
 	bool isMailto = this->url.find("mailto:") == 0;
 	bool isSpecial = this->url.find("special:") == 0;
 
-	this->url = sanitize_url(this->url);
+	this->url = navigationUrl(this->url);
+
+	// a link prefetched while it was tapped is taken over by the fetch below,
+	// any other prefetch is no longer wanted
+	if (this->url != prefetchedLink)
+		cancelLinkPrefetch();
+	prefetchedLink.clear();
+	linkPrefetch = nullptr;
+	hoveredLink.clear();
+
+	// going back or forward to a page we still have is instant
+	if (fromHistory && restoreDocument())
+		return;
+
 	std::cout << "Downloading page: " << this->url << std::endl;
 
 	// Update storage domain based on current URL (skip for special URLs)
@@ -296,8 +451,14 @@ void WebView::downloadPage()
 		updateStorageDomain();
 	}
 
-	// download the page
+	// download the page (the source of the page being left stays around, in
+	// case it goes to the back/forward cache once the new one is ready)
+	if (redirectCount == 0)
+		leavingContents = std::move(this->contents);
 	this->contents = "";
+	spilledContents = nullptr;
+	directImage.clear();
+	directImageFile = nullptr;
 
 	int httpCode = 0;
 	std::map<std::string, std::string> headerResp;
@@ -348,9 +509,359 @@ void WebView::downloadPage()
 	}
 	else
 	{
-		downloadFileToMemory(this->url, &this->contents, &httpCode, &headerResp);
+		// fetch in the background (or from the cache), the rest of the load
+		// continues in finishLoad
+		auto& scheduler = RequestScheduler::getInstance();
+		pendingLoad = scheduler.fetch(this->url, mainDisplay->privateMode,
+			PRIORITY_DOCUMENT, this,
+			[this, mainDisplay](NetRequest& request)
+			{
+				pendingLoad = nullptr;
+				if (!request.fromCache && !mainDisplay->privateMode)
+					HstsStore::getInstance().learn(request.url, request.headers);
+				if (request.fromCache)
+					std::cout << "Loaded from cache: " << request.url << std::endl;
+				else
+					countTransfer(request.bytesOnWire, request.bytesReceived);
+				this->contents = std::move(request.body);
+				spilledContents = request.spilled;
+				finishLoad(request.httpCode, request.headers);
+			},
+			[this](NetRequest& request)
+			{ onStreamData(request); },
+			revalidate);
+		return;
+	}
+
+	finishLoad(httpCode, headerResp);
+}
+
+void WebView::stopLoading()
+{
+	if (pendingLoad != nullptr)
+	{
+		std::cout << "Cancelling in-flight load: " << pendingLoad->url << std::endl;
+		pendingLoad = nullptr;
+	}
+
+	// along with the stylesheets and images it was waiting on
+	RequestScheduler::getInstance().cancelAll(this);
+}
+
+void WebView::downloadInstead(const std::map<std::string, std::string>& headers,
+	bool complete)
+{
+	auto mainDisplay = ((MainDisplay*)RootDisplay::mainDisplay);
+	auto& downloads = DownloadManager::getInstance();
+
+	// whole already (from the cache, or too quick to notice), or just started
+	if (complete)
+	{
+		downloads.save(this->url, headers, this->contents, spilledContents);
+		spilledContents = nullptr;
+	}
+	else
+	{
+		stopLoading();
+		downloads.start(this->url, headers, mainDisplay->privateMode);
+	}
+
+	// nothing was shown or added to the history yet, so just go back to it
+	this->url = documentUrl;
+	this->contents = std::move(leavingContents);
+	redirectCount = 0;
+	awaitingFirstPaint = false;
+	updateStorageDomain();
+	mainDisplay->urlBar->currentUrl = this->url;
+	mainDisplay->urlBar->updateInfo();
+	needsRender = true;
+}
+
+void WebView::prefetchLink(const std::string& href)
+{
+	if (href.empty())
+		return;
+
+	// request it exactly the way the navigation would, so that it matches
+	auto target = navigationUrl(href);
+	if (target == prefetchedLink)
+		return;
+
+	cancelLinkPrefetch();
+	if (target.find("http://") != 0 && target.find("https://") != 0)
+		return;
+
+	std::cout << "[WebView] Prefetching link " << target << std::endl;
+	prefetchedLink = target;
+	auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
+	linkPrefetch = RequestScheduler::getInstance().preload(target,
+		mainDisplay->privateMode, PRIORITY_PREFETCH, nullptr);
+}
+
+void WebView::cancelLinkPrefetch()
+{
+	// (once a navigation takes the prefetch over, it's no longer ours to cancel)
+	if (linkPrefetch != nullptr && linkPrefetch->speculative)
+		RequestScheduler::getInstance().cancel(linkPrefetch);
+	linkPrefetch = nullptr;
+	prefetchedLink.clear();
+}
+
+#ifdef LAYOUT_BENCHMARK
+void WebView::logLayoutStats(double layoutMs)
+{
+	auto& stats = container->textWidthStats;
+	if (stats.sampled > 0)
+	{
+		// extrapolated from the sampled calls, which were timed both ways
+		double saved = (stats.plainMs - stats.cachedMs) / stats.sampled * stats.calls;
+		std::cout << "[WebView] Layout took " << layoutMs << "ms, " << stats.calls
+				  << " text widths (about " << saved
+				  << "ms saved by the glyph advance tables";
+		if (stats.mismatches > 0)
+			std::cout << ", " << stats.mismatches << " of " << stats.sampled
+					  << " samples measured differently";
+		std::cout << ")" << std::endl;
+	}
+	stats = BrocContainer::TextWidthStats();
+}
+#endif
+
+void WebView::countTransfer(size_t bytesOnWire, size_t bytesDecoded)
+{
+	pageTransfers++;
+	pageBytesOnWire += bytesOnWire;
+	pageBytesDecoded += bytesDecoded;
+}
+
+void WebView::logTransferStats()
+{
+	if (pageTransfers > 0)
+	{
+		int saved = pageBytesDecoded > 0
+			? (int)(100 - pageBytesOnWire * 100 / pageBytesDecoded)
+			: 0;
+		std::cout << "[WebView] " << pageTransfers << " transfers, "
+				  << pageBytesOnWire / 1024 << "KB on the wire, "
+				  << pageBytesDecoded / 1024 << "KB decoded (" << saved
+				  << "% saved by compression)" << std::endl;
+	}
+
+	StylesheetCache::getInstance().logStats();
+	FontCache::getInstance().logStats();
+	TextRenderer::getInstance().logStats();
+	TileCache::getInstance().logStats();
+	if (container != nullptr)
+		container->displayList.logStats();
+	NetworkArchive::getInstance().logStats();
+
+	pageTransfers = 0;
+	pageBytesOnWire = 0;
+	pageBytesDecoded = 0;
+}
+
+// true if the bytes so far look like markup (and not an image or other binary)
+static bool looksLikeHtml(const std::string& data)
+{
+	auto start = data.find_first_not_of(" \t\r\n\xef\xbb\xbf");
+	return start != std::string::npos && data[start] == '<';
+}
+
+void WebView::preloadSubresources(const std::string& received)
+{
+	if (!looksLikeHtml(received))
+		return;
+
+	// resolve against the page being loaded the same way its container will,
+	// so the urls match when the document asks for them
+	auto base = urlBaseOf(this->url);
+
+	auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
+	auto& scheduler = RequestScheduler::getInstance();
+
+	for (auto& resource : preloadScanner.scan(received))
+	{
+		FetchPriority priority;
+		if (resource.kind == PRELOAD_STYLESHEET)
+			priority = PRIORITY_STYLESHEET;
+		else if (resource.kind == PRELOAD_IMAGE && !resource.lazy && preloadedImages < PRELOAD_MAX_IMAGES)
+		{
+			priority = PRIORITY_NEAR_VIEWPORT;
+			preloadedImages++;
+		}
+		else
+			continue; // external scripts aren't run, and fonts come from the system
+
+		auto url = resolveUrl(base, resource.url.c_str());
+		if (url.find("http://") != 0 && url.find("https://") != 0)
+			continue;
+
+		std::cout << "[WebView] Preloading " << url << std::endl;
+		scheduler.preload(url, mainDisplay->privateMode, priority, this,
+			[this](NetRequest& response)
+			{
+				if (!response.fromCache)
+					countTransfer(response.bytesOnWire, response.bytesReceived);
+			});
+	}
+}
+
+// an error page's body isn't CSS, however it got here
+static bool usableStylesheet(const NetRequest& response)
+{
+	return response.success && response.httpCode < 400;
+}
+
+void WebView::importStylesheet(const std::string& url, std::string& text)
+{
+	if (url.empty())
+		return;
+
+	// already here (or still on its way, the restyle will pick it up)
+	auto known = stylesheets.find(url);
+	if (known != stylesheets.end())
+	{
+		text.append(known->second);
+		return;
+	}
+	if (pendingStylesheets.count(url))
+		return;
+
+	// an earlier page may have loaded it already
+	auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
+	bool isPrivate = mainDisplay->privateMode;
+	std::string cached;
+	if (StylesheetCache::getInstance(isPrivate).lookup(url, cached))
+	{
+		text.append(cached);
+		stylesheets[url] = std::move(cached);
+		return;
+	}
+
+	// the preload scanner may have fetched it while the page streamed in (for
+	// this tab's partition, a response from the other one is never stored)
+	auto& scheduler = RequestScheduler::getInstance();
+	auto preloaded = scheduler.preloaded(url, isPrivate);
+	if (preloaded != nullptr && usableStylesheet(*preloaded))
+	{
+		StylesheetCache::getInstance(isPrivate).store(url, preloaded->body);
+		stylesheets[url] = preloaded->body;
+		text.append(preloaded->body);
+		return;
+	}
+
+	// lay the page out without it for now, all sheets download in parallel
+	std::cout << "[WebView] Fetching stylesheet " << url << std::endl;
+	pendingStylesheets.insert(url);
+	scheduler.fetch(url, isPrivate, PRIORITY_STYLESHEET, this,
+		[this, url, isPrivate](NetRequest& response)
+		{
+			if (!response.fromCache)
+				countTransfer(response.bytesOnWire, response.bytesReceived);
+
+			pendingStylesheets.erase(url);
+			bool usable = usableStylesheet(response);
+			stylesheets[url] = usable ? response.body : "";
+			if (usable)
+			{
+				StylesheetCache::getInstance(isPrivate).store(url, response.body);
+				needsRestyle = true;
+			}
+		});
+}
+
+bool WebView::blockedOnStylesheets() const
+{
+	// only the first paint waits, after that sheets are applied as they come
+	if (!awaitingFirstPaint || pendingStylesheets.empty())
+		return false;
+	return std::chrono::steady_clock::now() - loadStartTime
+		< std::chrono::milliseconds(stylesheetTimeoutMs);
+}
+
+void WebView::restyleDocument()
+{
+	needsRestyle = false;
+	if (container == nullptr || m_doc == nullptr)
+		return;
+
+	// litehtml can't add a stylesheet to a parsed document, so parse the same
+	// source again into the same container (its images and fonts stay loaded),
+	// this time with every sheet that has arrived. Like recreateDocument, this
+	// doesn't run the page's scripts again.
+	std::cout << "[WebView] Restyling with " << stylesheets.size()
+			  << " stylesheets (" << pendingStylesheets.size() << " pending)"
+			  << std::endl;
+	container->cleanupAllOverlays();
+	auto& m_css = StylesheetCache::getInstance().masterCss();
+	this->m_doc = litehtml::document::createFromString(this->contents.c_str(), container, m_css);
+	this->needsRender = true;
+}
+
+void WebView::onStreamData(NetRequest& request)
+{
+	// not a page at all, no need to wait for the rest of it
+	if (request.headersReady && !request.headers.count("location")
+		&& DownloadManager::isDownload(request.headers))
+	{
+		downloadInstead(request.headers, false);
+		return;
 	}
 
+	// look ahead on every chunk, well before it's worth parsing
+	preloadSubresources(request.received);
+
+	if (!streamingParse || partialParses >= STREAM_MAX_PARTIAL_PARSES)
+		return;
+
+	auto& received = request.received;
+
+	// wait for a decent chunk before the first paint, then for the page to at
+	// least double before relaying it out again
+	auto threshold = partialParses == 0 ? STREAM_FIRST_PAINT_BYTES : lastPartialSize * 2;
+	if (received.size() < threshold)
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	if (partialParses > 0 && now - lastPartialTime < std::chrono::milliseconds(STREAM_RELAYOUT_INTERVAL_MS))
+		return;
+
+	if (!looksLikeHtml(received))
+		return;
+
+	// cut off at the last complete tag, so we never parse half of one
+	auto lastTag = received.rfind('>');
+	if (lastTag == std::string::npos)
+		return;
+
+	std::cout << "[WebView] Partial parse #" << partialParses + 1 << " with "
+			  << lastTag + 1 << " bytes" << std::endl;
+
+	this->contents = received.substr(0, lastTag + 1);
+	createDocument();
+
+	// a fresh page starts at the top, but only the first time (the user may
+	// have started scrolling by the time the rest arrives)
+	if (partialParses == 0)
+		this->y = minYScroll;
+
+	partialParses++;
+	lastPartialSize = received.size();
+	lastPartialTime = now;
+}
+
+float WebView::loadProgress() const
+{
+	if (pendingLoad == nullptr || pendingLoad->request == nullptr)
+		return pendingLoad != nullptr ? 0.0f : 1.0f;
+	return pendingLoad->request->progress();
+}
+
+void WebView::finishLoad(int httpCode,
+	std::map<std::string, std::string> headerResp)
+{
+	auto mainDisplay = ((MainDisplay*)RootDisplay::mainDisplay);
+
 	if (redirectCount > 10)
 	{
 		std::cout << "Too many redirects, aborting" << std::endl;
@@ -364,21 +875,43 @@ void WebView::downloadPage()
 		return;
 	}
 
+	if (DownloadManager::isDownload(headerResp))
+	{
+		downloadInstead(headerResp, true);
+		return;
+	}
+
 	// check for image mime type and use the image container template
 	auto contentType = headerResp["content-type"];
 	if (contentType.find("image/") == 0)
 	{
-		// convert contents to base64 image url
-		std::string base64Contents = base64_encode(this->contents);
-		base64Contents = "data:" + contentType + ";base64," + base64Contents;
-		this->contents = load_special_page("image_container", base64Contents.c_str());
+		// the container refers to the image by this url, and load_image decodes
+		// the bytes we already have for it (rather than a base64 copy of them)
+		directImage = std::move(this->contents);
+		directImageFile = std::move(spilledContents);
+		std::string src;
+		for (char c : this->url)
+		{
+			if (c == '"')
+				src += "&quot;";
+			else if (c == '&')
+				src += "&amp;";
+			else if (c == '<')
+				src += "&lt;";
+			else
+				src += c;
+		}
+		this->contents = load_special_page("image_container", src.c_str());
+	}
+	else if (spilledContents != nullptr)
+	{
+		// too big to have streamed into memory, but litehtml needs it whole
+		this->contents = readFile(spilledContents->path);
 	}
+	spilledContents = nullptr;
 
 	// std::cout << "Contents: " << this->contents << std::endl;
 
-	// load the master CSS file as a regular file into the string
-	auto m_css = readFile(RAMFS "res/master.css");
-
 	// hack to show flex box containers
 	// std::replace(this->contents.begin(), this->contents.end(), "flex",
 	// "block"); std::regex e ("\\b(sub)([^ ]*)");   // matches words beginning by
@@ -387,18 +920,59 @@ void WebView::downloadPage()
 	// std::cout << std::regex_replace (this->contents, e, "sub-$2");
 	// std::cout << std::endl;
 
-	// TODO: extract all the below rendering logic into another method
+	createDocument();
 
-	if (container != nullptr)
+	// it's whole now, so it can be kept for back/forward (special pages are
+	// cheap to rebuild, and may have changed by the time we return anyway)
+	documentComplete = this->url.find("special:") != 0;
+	documentUrl = this->url;
+
+	std::cout << "About to execute page scripts..." << std::endl;
+	// Execute JavaScript after document is loaded
+	executePageScripts();
+	std::cout << "Page scripts executed successfully" << std::endl;
+
+	// clear and append the history up to this point, if the current index is not
+	// the current url
+	if (historyIndex < 0 || history[historyIndex] != this->url)
 	{
-		// delete all children
-		wipeAll();
+		history.erase(history.begin() + historyIndex + 1, history.end());
+		history.push_back(this->url);
+		historyIndex = history.size() - 1;
+
+		// show the clock
+		auto urlBar = mainDisplay->urlBar;
+		urlBar->clockButton->hidden = false;
+		urlBar->forwardButton->hidden = true;
+	}
+
+	mainDisplay->urlBar->webView = this;
+	mainDisplay->urlBar->currentUrl = this->url;
+	mainDisplay->urlBar->updateInfo();
+
+	// jump up to the top of the page (TODO: store scroll position for the
+	// history), unless a streamed partial page already did
+	if (partialParses == 0)
+		this->y = minYScroll; // url bar height
+}
 
-		// Clean up any existing Chesto overlays before creating a new container
+void WebView::createDocument()
+{
+	// the master CSS file is only read from disk once
+	auto& m_css = StylesheetCache::getInstance().masterCss();
+
+	// the partial parses of a streamed page, and the final one, all go into the
+	// same container (like a restyle does), so the images it has already asked
+	// for keep downloading instead of being cancelled and requested again
+	if (container != nullptr && partialParses > 0)
 		container->cleanupAllOverlays();
+	else
+	{
+		releaseDocument(std::move(leavingContents));
 
-		// TODO: crashes, deletes too early, but do this instead
-		prevContainer = container;
+		container = new BrocContainer(this);
+		// printf("Resetting container\n");
+		container->set_base_url(this->url.c_str());
 	}
 
 	// reset the theme color
@@ -407,10 +981,6 @@ void WebView::downloadPage()
 	// reset the dynamic title flag for new page loads
 	this->titleSetDynamically = false;
 
-	container = new BrocContainer(this);
-	// printf("Resetting container\n");
-	container->set_base_url(this->url.c_str());
-
 	std::cout << "About to create litehtml document from contents..."
 			  << std::endl;
 	this->m_doc = litehtml::document::createFromString(this->contents.c_str(), container, m_css);
@@ -423,33 +993,104 @@ void WebView::downloadPage()
 	{
 		container->navigationInProgress = false;
 	}
+}
 
-	std::cout << "About to execute page scripts..." << std::endl;
-	// Execute JavaScript after document is loaded
-	executePageScripts();
-	std::cout << "Page scripts executed successfully" << std::endl;
+void WebView::releaseDocument(std::string source)
+{
+	if (container == nullptr)
+		return;
 
-	// clear and append the history up to this point, if the current index is not
-	// the current url
-	if (historyIndex < 0 || history[historyIndex] != this->url)
+	// keep a finished page for back/forward, unless it's just being reloaded
+	if (useBackForwardCache && documentComplete && documentUrl != this->url)
 	{
-		history.erase(history.begin() + historyIndex + 1, history.end());
-		history.push_back(this->url);
-		historyIndex = history.size() - 1;
-
-		// show the clock
-		auto urlBar = mainDisplay->urlBar;
-		urlBar->clockButton->hidden = false;
-		urlBar->forwardButton->hidden = true;
+		stashDocument(std::move(source));
+		return;
 	}
+	documentComplete = false;
+
+	// delete all children
+	wipeAll();
+
+	// Clean up any existing Chesto overlays before creating a new container
+	container->cleanupAllOverlays();
+
+	// a container that was swapped out earlier isn't referenced by any
+	// document anymore
+	if (prevContainer != nullptr)
+		delete prevContainer;
+
+	// TODO: crashes, deletes too early, but do this instead
+	prevContainer = container;
+}
 
+void WebView::stashDocument(std::string source)
+{
+	auto page = std::make_unique<CachedPage>();
+	page->owner = this;
+	page->url = documentUrl;
+
+	// overlays are rebuilt from the document when it's shown again, but the
+	// images (and their textures) go along with it
+	container->cleanupAllOverlays();
+	page->children = std::move(elements);
+	elements.clear();
+
+	page->document = m_doc;
+	page->container = container;
+	page->contents = std::move(source);
+	page->windowTitle = windowTitle;
+	page->themeColor = theme_color;
+	page->scrollY = this->y;
+
+	page->size = page->contents.size() * BFCACHE_DOM_BYTES_PER_SOURCE_BYTE;
+	for (auto child : page->children)
+		page->size += (size_t)child->width * child->height * 4;
+
+	m_doc = nullptr;
+	container = nullptr;
+	documentComplete = false;
+
+	BackForwardCache::getInstance().store(std::move(page));
+}
+
+bool WebView::restoreDocument()
+{
+	auto page = BackForwardCache::getInstance().take(this, this->url);
+	if (page == nullptr)
+		return false;
+
+	std::cout << "Restoring page from back/forward cache: " << this->url << std::endl;
+
+	// the page being left can come back the same way
+	releaseDocument(std::move(this->contents));
+
+	m_doc = page->document;
+	container = page->container;
+	for (auto child : page->children)
+		this->child(child);
+	page->document = nullptr;
+	page->container = nullptr;
+	page->children.clear();
+
+	this->contents = std::move(page->contents);
+	this->theme_color = page->themeColor;
+	this->y = page->scrollY;
+	if (!page->windowTitle.empty())
+		setTitle(page->windowTitle);
+
+	documentComplete = true;
+	documentUrl = this->url;
+	restoredPage = true;
+	container->imagePrioritiesDirty = true;
+	needsRender = true;
+
+	updateStorageDomain();
+
+	auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
 	mainDisplay->urlBar->webView = this;
 	mainDisplay->urlBar->currentUrl = this->url;
 	mainDisplay->urlBar->updateInfo();
-
-	// jump up to the top of the page (TODO: store scroll position for the
-	// history)
-	this->y = minYScroll; // url bar height
+	return true;
 }
 
 void WebView::screenshot(std::string path)
@@ -804,6 +1445,9 @@ void WebView::goTo(const std::string& newUrl)
 {
 	std::cout << "Navigation requested: " << newUrl << std::endl;
 
+	// abandon whatever was loading before
+	stopLoading();
+
 	// Update the URL
 	this->url = newUrl;
 
@@ -834,6 +1478,7 @@ void WebView::reloadPage()
 {
 	std::cout << "Page reload requested" << std::endl;
 	needsLoad = true;
+	revalidateNextLoad = true; // don't trust the cache for an explicit reload
 	redirectCount = 0;
 
 	this->y = minYScroll; // reset scroll position to top
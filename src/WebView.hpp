@@ -3,19 +3,53 @@
 
 #include "../libs/chesto/src/ListElement.hpp"
 #include "JSEngine.hpp"
+#include <chrono>
 #include <litehtml.h>
 #include <map>
+#include <set>
 #include <string>
 #include <memory>
 #include "../libs/chesto/src/AlertDialog.hpp"
 #include "AlertManager.hpp"
+#include "../utils/PreloadScanner.hpp"
 
 #define START_PAGE "special://home"
 #define SEARCH_URL "https://html.duckduckgo.com/html?q="
 
+// streaming parse: lay out what has arrived once this much of the page is in,
+// then re-parse at most a couple more times while the rest streams in
+#define STREAM_FIRST_PAINT_BYTES 0x4000
+#define STREAM_MAX_PARTIAL_PARSES 3
+#define STREAM_RELAYOUT_INTERVAL_MS 750
+
+// images further than this many pixels above or below the viewport wait until
+// scrolling brings them closer (about a screen on the Switch)
+#define LAZY_LOAD_MARGIN 720
+
+// images that the preload scanner starts early, the first few are likely to be
+// above the fold (the rest wait for layout and lazy loading)
+#define PRELOAD_MAX_IMAGES 4
+
+// stylesheets download without holding up the parse, but the first paint waits
+// this long for them (so one slow CDN can't keep the page blank)
+#define STYLESHEET_BLOCKING_TIMEOUT_MS 1500
+
+// a link that the pointer (or joystick cursor) rests on this long is fetched
+// in case it's clicked, ones that are touched are fetched right away
+#define LINK_HOVER_PREFETCH_MS 250
+
+// once a page has loaded, the hosts it hints at or links to are looked up ahead
+// of time, and the hinted and most linked ones get a warm connection (these
+// limits count both)
+#define LINK_DNS_PREFETCH_MAX_HOSTS 16
+#define LINK_PRECONNECT_MAX_HOSTS 3
+
 // TODO: no forward declare
 class BrocContainer;
 class VirtualDOM;
+struct NetRequest;
+struct ScheduledFetch;
+struct SpilledBody;
 
 class WebView : public ListElement
 {
@@ -63,6 +97,30 @@ public:
 	CST_Color theme_color = { 0xdd, 0xdd, 0xdd, 0xff };
 
 	void downloadPage();
+	void finishLoad(int httpCode, std::map<std::string, std::string> headerResp);
+	void createDocument();
+
+	// back/forward cache: the current document can be kept once it has fully
+	// loaded, and history navigation puts kept ones back as they were
+	bool useBackForwardCache = true;
+	bool historyNavigation = false; // set by the back/forward buttons
+	bool documentComplete = false;
+	bool restoredPage = false;
+	std::string documentUrl;	 // what the current document was loaded from
+	std::string leavingContents; // its source, while the next page loads
+
+	// the download, if it was too big to keep in memory (finishLoad reads it
+	// back, or hands it straight to the image for a direct image navigation)
+	std::shared_ptr<SpilledBody> spilledContents;
+
+	// a direct image navigation's own bytes (or the file they spilled to), for
+	// the image container page to decode without a data: url round trip
+	std::string directImage;
+	std::shared_ptr<SpilledBody> directImageFile;
+	void releaseDocument(std::string source);
+	void stashDocument(std::string source);
+	bool restoreDocument();
+	void onStreamData(NetRequest& request);
 	bool handle_http_code(int httpCode,
 		std::map<std::string, std::string> headerResp);
 
@@ -70,8 +128,82 @@ public:
 	void render(Element* parent);
 
 	bool needsLoad = true;
+	// lay the document out again on the next frame (set it as often as needed,
+	// eg. once per arriving image, it still only costs one layout per frame)
 	bool needsRender = true;
 
+	// the page fetch currently in flight, if any
+	std::shared_ptr<ScheduledFetch> pendingLoad;
+	bool isLoading() const { return pendingLoad != nullptr; }
+	float loadProgress() const;
+	void stopLoading();
+
+	// the page being loaded turned out to be a file to save rather than show,
+	// hand it (or what's left of its download) to the download manager and
+	// stay on the page we were on
+	void downloadInstead(const std::map<std::string, std::string>& headers,
+		bool complete);
+
+	// only fetch images once they come within lazyLoadMargin of the viewport
+	// (loading="lazy" images always wait, loading="eager" ones never do)
+	bool lazyLoadImages = true;
+	int lazyLoadMargin = LAZY_LOAD_MARGIN;
+
+	// set by reloads, so the next load checks with the server even if cached
+	bool revalidateNextLoad = false;
+
+	// parse and paint partial documents while the page is still streaming in
+	bool streamingParse = true;
+	int partialParses = 0;
+	size_t lastPartialSize = 0;
+	std::chrono::steady_clock::time_point lastPartialTime;
+
+	// finds stylesheets and images in the page while it streams in, so they
+	// download alongside it rather than after it has been parsed
+	PreloadScanner preloadScanner;
+	int preloadedImages = 0;
+	void preloadSubresources(const std::string& received);
+
+	// the document behind a link being tapped (or hovered) is fetched before
+	// the tap completes, and the navigation takes it over if it does. The
+	// prefetch is cancelled through its handle rather than as this view's,
+	// so that stopLoading leaves it alone.
+	bool prefetchLinks = true;
+	std::string prefetchedLink;
+	std::shared_ptr<ScheduledFetch> linkPrefetch;
+	std::string hoveredLink;
+	std::chrono::steady_clock::time_point hoveredSince;
+	void prefetchLink(const std::string& href);
+	void cancelLinkPrefetch();
+
+	// external stylesheets of the current page by url, fetched in parallel. The
+	// document is restyled (once per frame at most) as each one arrives.
+	std::map<std::string, std::string> stylesheets;
+	std::set<std::string> pendingStylesheets;
+	bool needsRestyle = false;
+	int stylesheetTimeoutMs = STYLESHEET_BLOCKING_TIMEOUT_MS;
+	void importStylesheet(const std::string& url, std::string& text);
+	void restyleDocument();
+	bool blockedOnStylesheets() const;
+
+	// time-to-first-paint for the most recent load, in milliseconds
+	std::chrono::steady_clock::time_point loadStartTime;
+	bool awaitingFirstPaint = false;
+	double firstPaintMs = 0;
+
+	// bytes the current page (document, stylesheets and images) pulled over the
+	// network, both compressed on the wire and after decoding
+	int pageTransfers = 0;
+	size_t pageBytesOnWire = 0;
+	size_t pageBytesDecoded = 0;
+	void countTransfer(size_t bytesOnWire, size_t bytesDecoded);
+	void logTransferStats();
+
+#ifdef LAYOUT_BENCHMARK
+	// how long a layout took, and what memoized text widths saved it
+	void logLayoutStats(double layoutMs);
+#endif
+
 	std::string fullSessionSummary();
 	// void screenshotPage();
 	void screenshot(std::string path);
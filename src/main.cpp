@@ -1,22 +1,48 @@
 #include "../libs/chesto/src/DownloadQueue.hpp"
 #include "../libs/chesto/src/Element.hpp"
+#include "../utils/NetworkArchive.hpp"
 #include "../utils/Utils.hpp"
 #include "MainDisplay.hpp"
 #include <algorithm>
+#include <cstdlib>
 #include <filesystem>
 
 int main(int argc, char* argv[])
 {
+	// benchmarking: --record <archive> saves every response, --replay <archive>
+	// serves them back offline, shaped by --profile 3ds|wiiu|switch and/or
+	// --latency <ms>, --bandwidth <KB/s> and --loss <percent>
+	std::string initialUrl;
+	auto& archive = NetworkArchive::getInstance();
+	for (int x = 1; x < argc; x++)
+	{
+		std::string arg = argv[x];
+		bool hasValue = x + 1 < argc;
+		if (arg == "--record" && hasValue)
+			archive.startRecording(argv[++x]);
+		else if (arg == "--replay" && hasValue)
+			archive.startReplaying(argv[++x]);
+		else if (arg == "--profile" && hasValue)
+			NetworkArchive::profile(argv[++x], archive.shaping);
+		else if (arg == "--latency" && hasValue)
+			archive.shaping.latencyMs = atoi(argv[++x]);
+		else if (arg == "--bandwidth" && hasValue)
+			archive.shaping.bandwidth = atoi(argv[++x]) * 1024;
+		else if (arg == "--loss" && hasValue)
+			archive.shaping.loss = atof(argv[++x]) / 100;
+		else
+			initialUrl = arg;
+	}
+
 	init_networking();
 
 	// initialize main title screen
 	MainDisplay* display = new MainDisplay();
 
 	// if a URL was provided as a command line argument, set it for the first tab
-	if (argc > 1)
+	if (!initialUrl.empty())
 	{
 		// hack: if it doesn't start with http:// or https://, assume it's a local file, and load with the current path
-		std::string initialUrl = argv[1];
 		if (initialUrl.find("http://") != 0 && initialUrl.find("https://") != 0)
 		{
 			auto pwd = std::filesystem::current_path();
@@ -8,10 +8,18 @@
 #include "../src/MuJSEngine.hpp"
 #endif
 #include "../src/MainDisplay.hpp"
+#include "../src/NetworkImage.hpp"
 #include "../src/URLBar.hpp"
+#include "ConnectionPool.hpp"
+#include "FontCache.hpp"
+#include "NetworkWorker.hpp"
+#include "RequestScheduler.hpp"
+#include "TileCache.hpp"
 #include "Utils.hpp"
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <set>
 #include <sstream>
 
 // This class implements the litehtml::document_container interface.
@@ -36,10 +44,6 @@ BrocContainer::create_font(const litehtml::font_description& descr,
 	auto italic = descr.style;
 	auto weight = descr.weight;
 
-	// auto fontKey = std::string(faceName) + "_" + std::to_string(size);
-
-	auto font = CST_CreateFont();
-
 	// TODO: handle system fonts based on platform (and include a few defaults
 	// here) if we have a comma or spaces, grab the right-most one
 	litehtml::string_vector fonts;
@@ -100,37 +104,48 @@ BrocContainer::create_font(const litehtml::font_description& descr,
 
 	fontPath += fontSlug + ".ttf";
 
-	std::cout << "Loading font: " << fontPath << std::endl;
-
-	auto renderer = (RootDisplay::mainDisplay)->renderer;
-	CST_LoadFont(font, renderer, fontPath.c_str(), size,
-		CST_MakeColor(0, 0, 0, 255), ttfStyles);
-
-	// save some info about the font
-	const char* sample_text = "Ag";  // 'A' for ascent, 'g' for descent
-	fm->x_height = CST_GetFontWidth(font, "x");
-	fm->ascent = FC_GetAscent(font, sample_text);
-	fm->descent = FC_GetDescent(font, sample_text);
-	fm->height = FC_GetHeight(font, sample_text);
-
-	// save this font to the cache
-	auto fontKey = ++eternalCounter;
-	this->fontCache[fontKey] = font;
+	// shared with every other page (and tab) using the same face
+	auto font = FontCache::getInstance().acquire(fontPath, size, ttfStyles);
+	fm->x_height = font->xHeight;
+	fm->ascent = font->ascent;
+	fm->descent = font->descent;
+	fm->height = font->height;
 
-	// return an ID for this font's key
-	return fontKey;
+	// the handle is the cached font itself
+	return (litehtml::uint_ptr)font;
 }
 
 void BrocContainer::delete_font(litehtml::uint_ptr hFont)
 {
-	this->fontCache.erase(hFont);
+	FontCache::getInstance().release((CachedFont*)hFont);
 }
 
 litehtml::pixel_t BrocContainer::text_width(const char* text,
 	litehtml::uint_ptr hFont)
 {
-	auto font = this->fontCache[hFont];
-	return (litehtml::pixel_t)CST_GetFontWidth(font, text);
+	auto font = (CachedFont*)hFont;
+#ifndef LAYOUT_BENCHMARK
+	return (litehtml::pixel_t)font->textWidth(text);
+#else
+	auto& stats = textWidthStats;
+	if (++stats.calls % TEXT_WIDTH_SAMPLE_RATE != 0)
+		return (litehtml::pixel_t)font->textWidth(text);
+
+	// time it both ways (timing every call would cost about as much as the
+	// lookups themselves)
+	auto start = std::chrono::steady_clock::now();
+	int width = font->textWidth(text);
+	auto middle = std::chrono::steady_clock::now();
+	int plainWidth = CST_GetFontWidth(font->font, text);
+	auto end = std::chrono::steady_clock::now();
+
+	stats.sampled++;
+	stats.cachedMs += std::chrono::duration<double, std::milli>(middle - start).count();
+	stats.plainMs += std::chrono::duration<double, std::milli>(end - middle).count();
+	if (width != plainWidth)
+		stats.mismatches++;
+	return (litehtml::pixel_t)width;
+#endif
 }
 
 void BrocContainer::draw_text(litehtml::uint_ptr hdc, const char* text,
@@ -138,22 +153,8 @@ void BrocContainer::draw_text(litehtml::uint_ptr hdc, const char* text,
 	litehtml::web_color color,
 	const litehtml::position& pos)
 {
-	auto renderer = RootDisplay::mainDisplay->renderer;
-	auto font = this->fontCache[hFont];
-
-	if (color.red != 0 || color.green != 0 || color.blue != 0)
-	{
-		// color font! create an effect and use that to draw
-		auto align = FC_ALIGN_LEFT;
-		auto effect = FC_MakeEffect(
-			align, FC_MakeScale(1, 1),
-			CST_MakeColor(color.red, color.green, color.blue, color.alpha));
-		FC_DrawEffect(font, renderer, pos.left(), pos.top(), effect, text);
-	}
-	else
-	{
-		CST_DrawFont(font, renderer, pos.left(), pos.top(), text);
-	}
+	displayList.addText((CachedFont*)hFont, text, pos.left(), pos.top(),
+		{ color.red, color.green, color.blue, color.alpha });
 }
 
 litehtml::pixel_t BrocContainer::pt_to_px(float pt) const
@@ -177,65 +178,9 @@ void BrocContainer::draw_list_marker(litehtml::uint_ptr hdc,
 	// printf("Requested to render list marker\n");
 }
 
-// convert the url component according to URI rules
 std::string BrocContainer::resolve_url(const char* src, const char* baseurl)
 {
-	std::stringstream ss;
-	std::string url;
-
-	// printf("Going to resolve url: %s\n", src);
-
-	if (strncmp(src, "https://", 8) == 0 || strncmp(src, "http://", 7) == 0 || strncmp(src, "data:", 5) == 0 || strncmp(src, "mailto:", 7) == 0 || strncmp(src, "javascript:", 11) == 0 || strncmp(src, "special:", 8) == 0 || strncmp(src, "localhost", 9) == 0 || strncmp(src, "file://", 7) == 0)
-	{
-		// this is a https/http/data/mailto/js uri, just use it directly
-		ss << src;
-		url = ss.str();
-	}
-	else if (baseurl == 0 || *baseurl == '\0')
-	{
-		if (strlen(src) > 0 && src[0] == '/')
-		{
-			if (strlen(src) > 1 && src[1] == '/')
-			{
-				// this is a starting double "//" url, just take the protocol
-				ss << this->protocol << ":" << src;
-			}
-			else
-			{
-				// this is a starting single "/" url, just take the domain
-				ss << this->base_domain << src;
-			}
-		}
-		else
-		{
-			// this is a relative url, take the base url
-			std::string curUrl = this->base_url;
-			// strip out the GET parameters (TODO: does this affect the baseurl
-			// elsewhere?)
-			auto questionMark = curUrl.find("?");
-			if (questionMark != std::string::npos)
-			{
-				curUrl = curUrl.substr(0, questionMark);
-			}
-			// same for the hash
-			auto hash = curUrl.find("#");
-			if (hash != std::string::npos)
-			{
-				curUrl = curUrl.substr(0, hash);
-			}
-			// make sure there's a trailing slash
-			if (curUrl[curUrl.length() - 1] != '/')
-			{
-				curUrl += "/";
-			}
-			ss << curUrl << src;
-		}
-
-		url = ss.str();
-	}
-	// printf("Resolved url: %s\n", url.c_str());
-
-	return url;
+	return resolveUrl(base, src, baseurl);
 }
 
 void BrocContainer::load_image(const char* src, const char* baseurl,
@@ -278,19 +223,42 @@ void BrocContainer::load_image(const char* src, const char* baseurl,
 		// file:// uri scheme
 		img = new ImageElement(("./data/" + urlCopy->substr(7)).c_str());
 	}
+	else if (newUrl == webView->url
+		&& (!webView->directImage.empty() || webView->directImageFile != nullptr))
+	{
+		// the page is this image (see WebView::finishLoad), it's already here
+		auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
+		auto netImage = new NetworkImage(newUrl, mainDisplay->privateMode, webView);
+		netImage->loadDownloaded(webView->directImage,
+			webView->directImageFile != nullptr ? webView->directImageFile->path : "");
+		std::string().swap(webView->directImage);
+		webView->directImageFile = nullptr;
+		img = netImage;
+	}
 	else
 	{
-		// normal url, load it from the network
+		// normal url, load it from the network (through the same worker and
+		// connection pool as the page itself), once prioritizeImages has seen
+		// where it ends up in the layout
 		// std::cout << "Requested to render Image [" << newUrl << "]" << std::endl;
-		auto urlCopy = new std::string(newUrl.c_str());
-		// printf("LOAD to render Image [%s]\n", urlCopy->c_str());
-		img = new NetImageElement(urlCopy->c_str(), []()
-			{
-      // could not load image, fallback
-      auto fallback = new ImageElement(RAMFS "res/redx.png");
-      fallback->setScaleMode(SCALE_PROPORTIONAL_WITH_BG);
-      return fallback; });
-		((NetImageElement*)img)->updateSizeAfterLoad = true;
+		auto mainDisplay = (MainDisplay*)RootDisplay::mainDisplay;
+		auto netImage = new NetworkImage(newUrl, mainDisplay->privateMode, webView);
+		auto view = webView;
+		netImage->onLoad = [view](NetworkImage* image)
+		{ view->countTransfer(image->bytesOnWire, image->bytesDecoded); };
+
+		// lay the page out again once the real size is known, unless the markup
+		// already pinned both dimensions (WebView::render coalesces any number
+		// of these into one layout per frame)
+		auto declared = declaredImageSizes.find(newUrl);
+		bool sizePinned = declared != declaredImageSizes.end()
+			&& declared->second.width > 0 && declared->second.height > 0;
+		if (!sizePinned)
+		{
+			netImage->onSize = [view](NetworkImage* image)
+			{ view->needsRender = true; };
+		}
+		img = netImage;
 	}
 
 	// save this image to the map cache to be positioned later
@@ -303,14 +271,112 @@ void BrocContainer::load_image(const char* src, const char* baseurl,
 	webView->child(img);
 }
 
+void BrocContainer::prioritizeImages()
+{
+	if (webView->m_doc == nullptr)
+		return;
+
+	if (imagePrioritiesDirty)
+	{
+		// layout changed, find out which elements the pending images belong to
+		pendingImages.clear();
+		std::set<NetworkImage*> placed;
+		auto root = webView->m_doc->root();
+		if (root)
+		{
+			for (auto& el : root->select_all("img"))
+			{
+				const char* src = el->get_attr("src");
+				if (src == nullptr || *src == '\0')
+					continue;
+
+				auto cached = imageCache.find(resolve_url(src, nullptr));
+				if (cached == imageCache.end())
+					continue;
+
+				auto image = dynamic_cast<NetworkImage*>(cached->second);
+				if (image == nullptr)
+					continue;
+				placed.insert(image);
+				if (image->loaded)
+					continue;
+
+				std::string loading = toLower(el->get_attr("loading", ""));
+				pendingImages.push_back({ el, image, loading == "lazy", loading == "eager" });
+			}
+		}
+
+		// anything else (eg. CSS backgrounds) has no element to measure, so
+		// just let it load behind everything else
+		for (auto& [url, texture] : imageCache)
+		{
+			auto image = dynamic_cast<NetworkImage*>(texture);
+			if (image != nullptr && !placed.count(image))
+				image->load(PRIORITY_BACKGROUND);
+		}
+	}
+	else if (webView->y == prioritizedScrollY)
+		return;
+
+	imagePrioritiesDirty = false;
+	prioritizedScrollY = webView->y;
+
+	int margin = webView->lazyLoadMargin;
+	int top = -webView->y;
+	int bottom = top + RootDisplay::screenHeight;
+
+	for (auto& pending : pendingImages)
+	{
+		auto image = pending.image;
+		if (image->loaded)
+			continue;
+
+		auto pos = pending.element->get_placement();
+		if (pos.bottom() >= top && pos.top() <= bottom)
+		{
+			image->load(PRIORITY_VISIBLE);
+			image->setPriority(PRIORITY_VISIBLE);
+		}
+		else if (pos.bottom() >= top - margin && pos.top() <= bottom + margin)
+		{
+			image->load(PRIORITY_NEAR_VIEWPORT);
+			image->setPriority(PRIORITY_NEAR_VIEWPORT);
+		}
+		else if (image->requested())
+			image->setPriority(PRIORITY_BACKGROUND);
+		else if (pending.eager || (!webView->lazyLoadImages && !pending.lazy))
+			image->load(PRIORITY_BACKGROUND);
+
+		// otherwise it stays deferred until scrolling brings it within the margin
+	}
+}
+
 void BrocContainer::get_image_size(const char* src, const char* baseurl,
 	litehtml::size& sz)
 {
 	// look up in cache
 	auto resolvedUrl = resolve_url(src, baseurl);
-	auto img = this->imageCache[resolvedUrl];
+	auto cached = this->imageCache.find(resolvedUrl);
+	auto img = cached != this->imageCache.end() ? cached->second : nullptr;
+
+	// network images know their size from the header, long before decoding
+	auto netImage = dynamic_cast<NetworkImage*>(img);
+	if (netImage != nullptr && netImage->naturalWidth > 0)
+	{
+		sz.width = netImage->naturalWidth;
+		sz.height = netImage->naturalHeight;
+		return;
+	}
 
-	if (img != nullptr)
+	// otherwise go by what the markup said, if anything
+	auto declared = declaredImageSizes.find(resolvedUrl);
+	if (declared != declaredImageSizes.end())
+	{
+		sz = declared->second;
+		return;
+	}
+
+	if (img != nullptr && netImage == nullptr)
 	{
 		sz.width = img->width;
 		sz.height = img->height;
@@ -323,8 +389,6 @@ void BrocContainer::draw_image(litehtml::uint_ptr hdc,
 	const std::string& base_url)
 {
 	// printf("Requested to draw image\n");
-	auto renderer = RootDisplay::mainDisplay->renderer;
-
 	CST_Rect dimens = { bg.origin_box.x, bg.origin_box.y, bg.origin_box.width,
 		bg.origin_box.height };
 
@@ -340,15 +404,9 @@ void BrocContainer::draw_image(litehtml::uint_ptr hdc,
 		{
 			// printf("Positioning image: %s, postion %f, %f\n", url.c_str(),
 			// bg.origin_box.x, bg.origin_box.y);
-			img->setPosition(webView->x + bg.origin_box.x,
-				-1 * webView->y + bg.origin_box.y);
-			img->setSize(dimens.w, dimens.h);
-
-			// if it's not a background attachment, move it to the front
-			if (bg.attachment ) {
-				// printf("Moving image named %s to front, background_attachment=%d\n", bg.image.c_str(), bg.attachment);
-				img->moveToFront();
-			}
+			// (if it's not a background attachment, it goes to the front)
+			displayList.addImage(img, dimens.x, dimens.y, dimens.w, dimens.h,
+				bg.attachment);
 		}
 	}
 	else
@@ -356,10 +414,6 @@ void BrocContainer::draw_image(litehtml::uint_ptr hdc,
 		// no image, draw a filled rectangle
 		printf("NOTICE: Shouldn't be here, draw_solid_fill should have been called "
 			   "instead\n");
-		auto radius = bg.border_radius.top_left_x; // TODO: all corners?
-												   // CST_roundedBoxRGBA(renderer, dimens.x, dimens.y, dimens.x + dimens.w,
-												   // dimens.y + dimens.h, radius, bg.color.red, bg.color.green, bg.color.blue,
-												   // bg.color.alpha);
 	}
 }
 
@@ -368,22 +422,13 @@ void BrocContainer::draw_solid_fill(litehtml::uint_ptr hdc,
 	const litehtml::web_color& color)
 {
 	// printf("Requested to draw solid fill\n");
-	auto renderer = RootDisplay::mainDisplay->renderer;
-
-	CST_Rect dimens = { layer.border_box.x, // clip_box?
-		layer.border_box.y, layer.border_box.width,
-		layer.border_box.height };
-
 	// printf("Fill drawn at: %d, %d, %d, %d\n", dimens.x, dimens.y, dimens.w,
 	// dimens.h); printf("Color: %d, %d, %d, %d\n", color.red, color.green,
 	// color.blue, color.alpha);
-
-	// auto chestoColor = CST_MakeColor(color.red, color.green, color.blue,
-	// color.alpha);
-	CST_roundedBoxRGBA(
-		renderer, dimens.x, dimens.y, dimens.x + dimens.w, dimens.y + dimens.h,
+	displayList.addFill(layer.border_box.x, // clip_box?
+		layer.border_box.y, layer.border_box.width, layer.border_box.height,
 		layer.border_radius.top_left_x, // harcoded to top left corner for now
-		color.red, color.green, color.blue, color.alpha);
+		{ color.red, color.green, color.blue, color.alpha });
 }
 
 void BrocContainer::draw_linear_gradient(
@@ -439,11 +484,9 @@ void BrocContainer::draw_borders(litehtml::uint_ptr hdc,
 	// TODO: get other border colors, for now grab the top one
 	auto color = borders.top.color;
 
-	auto renderer = RootDisplay::mainDisplay->renderer;
 	auto radius = borders.radius.top_left_x; // TODO: all corners?
-	CST_roundedRectangleRGBA(renderer, dimens.x, dimens.y, dimens.x + dimens.w,
-		dimens.y + dimens.h, radius, color.red, color.green,
-		color.blue, color.alpha);
+	displayList.addBorder(dimens.x, dimens.y, dimens.w, dimens.h, radius,
+		{ color.red, color.green, color.blue, color.alpha });
 }
 
 void BrocContainer::set_caption(const char* caption)
@@ -459,34 +502,7 @@ void BrocContainer::set_caption(const char* caption)
 
 void BrocContainer::set_base_url(const char* base_url)
 {
-	// std::cout << "Setting base url to: " << base_url << std::endl;
-	std::string url = base_url;
-
-	// we assume we have a proper protocol set
-	auto protoPos = url.find("://") + 3;
-
-	// extract base url from full URL
-	auto endPos = url.find_last_of("/");
-	this->base_url = url.substr(0, protoPos) + url.substr(protoPos, endPos);
-	if (endPos < protoPos)
-	{
-		// just use the URL as is, with a trailing slash
-		this->base_url = url;
-	}
-
-	// extract base domain from full URL
-	url += "/";
-	std::string protocol = url.substr(0, url.find("://"));
-	std::string domain = url.substr(url.find("://") + 3);
-
-	auto endingSlashPos = domain.find("/");
-	if (endingSlashPos != std::string::npos)
-	{
-		domain = domain.substr(0, endingSlashPos);
-	}
-	this->base_domain = protocol + "://" + domain;
-
-	this->protocol = protocol;
+	base = urlBaseOf(base_url);
 }
 
 void BrocContainer::link(const std::shared_ptr<litehtml::document>& doc,
@@ -570,10 +586,8 @@ void BrocContainer::import_css(litehtml::string& text,
 	std::cout << "Importing CSS: " << text << ", " << url << std::endl;
 	std::string newUrl = resolve_url(url.c_str(), baseurl.c_str());
 	std::cout << "Resolved URL: " << newUrl << std::endl;
-	/// download the CSS file
-	// TODO: do this asynchronously and re-update the page when it's done
-	std::string contents;
-	downloadFileToMemory(newUrl.c_str(), &text);
+	// fetched in the background, the page is restyled once it arrives
+	webView->importStylesheet(newUrl, text);
 }
 
 void BrocContainer::set_clip(const litehtml::position& pos,
@@ -583,11 +597,29 @@ void BrocContainer::set_clip(const litehtml::position& pos,
 	// radiuses: %d, %d, %d, %d\n", pos.left(), pos.top(), pos.right(),
 	// pos.bottom(), bdr_radius.top_left_x, bdr_radius.top_left_y,
 	// bdr_radius.bottom_right_x, bdr_radius.bottom_right_y);
+	displayList.pushClip(pos.x, pos.y, pos.width, pos.height);
 }
 
 void BrocContainer::del_clip()
 {
 	// printf("Call from del_clip\n");
+	displayList.popClip();
+}
+
+void BrocContainer::recordDisplayList()
+{
+	// at the document's origin, replay adds the scroll
+	auto start = std::chrono::steady_clock::now();
+	displayList.clear();
+	webView->m_doc->draw((litehtml::uint_ptr)this, 0, 0, nullptr);
+	displayList.document = webView->m_doc.get();
+	displayList.hashTiles(TILE_SIZE);
+	displayList.placeImages(webView->x);
+	displayList.recordings++;
+	displayList.recordMs += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start)
+								.count();
+	displayListDirty = false;
 }
 
 void BrocContainer::get_viewport(litehtml::position& client) const
@@ -618,6 +650,23 @@ BrocContainer::create_element(const char* tag_name,
 		return element; // Return nullptr to use default litehtml button element
 	}
 
+	if (std::string(tag_name) == "img" && attributes.count("src") > 0)
+	{
+		// remember any size the markup gives, for get_image_size
+		auto width = attributes.find("width");
+		auto height = attributes.find("height");
+		if (width != attributes.end() && height != attributes.end())
+		{
+			int w = atoi(width->second.c_str());
+			int h = atoi(height->second.c_str());
+			if (w > 0 && h > 0)
+			{
+				auto url = resolve_url(attributes.at("src").c_str(), nullptr);
+				declaredImageSizes[url] = litehtml::size(w, h);
+			}
+		}
+	}
+
 	if (std::string(tag_name) == "meta" && attributes.count("name") > 0)
 	{
 		printf("Found meta tag\n");
@@ -1446,6 +1495,120 @@ bool BrocContainer::createChestoLinkFromElement(
 	return false;
 }
 
+// scheme://host[:port] of an absolute http(s) url, or empty
+static std::string originOf(const std::string& url)
+{
+	if (url.find("http://") != 0 && url.find("https://") != 0)
+		return "";
+	auto end = url.find_first_of("/?#", url.find("://") + 3);
+	return toLower(url.substr(0, end));
+}
+
+void BrocContainer::warmLinkHosts()
+{
+	if (linkHostsWarmed || !webView->m_doc || !webView->m_doc->root())
+		return;
+	linkHostsWarmed = true;
+
+	auto root = webView->m_doc->root();
+	auto pageOrigin = originOf(base.url);
+	auto& pool = ConnectionPool::getInstance();
+	bool isPrivate = ((MainDisplay*)RootDisplay::mainDisplay)->privateMode;
+
+	// the page's own hints go first, they know what's coming, but they share
+	// the same limits (past the preconnects, a preconnect is only looked up)
+	int warmed = 0;
+	int connected = 0;
+	std::set<std::string> hinted;
+	for (auto& el : root->select_all("link[href]"))
+	{
+		if (warmed >= LINK_DNS_PREFETCH_MAX_HOSTS)
+			break;
+
+		auto rel = " " + toLower(el->get_attr("rel", "")) + " ";
+		bool preconnect = rel.find(" preconnect ") != std::string::npos;
+		if (!preconnect && rel.find(" dns-prefetch ") == std::string::npos)
+			continue;
+
+		auto origin = originOf(resolve_url(el->get_attr("href"), nullptr));
+		if (origin.empty() || origin == pageOrigin || hinted.count(origin))
+			continue;
+		hinted.insert(origin);
+		if (preconnect && connected < LINK_PRECONNECT_MAX_HOSTS)
+		{
+			pool.preconnect(origin, isPrivate);
+			connected++;
+		}
+		else
+			pool.prefetchDns(origin, isPrivate);
+		warmed++;
+	}
+
+	// then the other sites this page links to, most linked first
+	std::map<std::string, int> linkCounts;
+	for (auto& el : root->select_all("a[href]"))
+	{
+		auto origin = originOf(resolve_url(el->get_attr("href"), nullptr));
+		if (!origin.empty() && origin != pageOrigin && !hinted.count(origin))
+			linkCounts[origin]++;
+	}
+
+	std::vector<std::pair<int, std::string>> byCount;
+	for (auto& [origin, count] : linkCounts)
+		byCount.push_back({ count, origin });
+	std::sort(byCount.begin(), byCount.end(),
+		[](const auto& a, const auto& b) { return a.first > b.first; });
+
+	int linked = 0;
+	for (auto& [count, origin] : byCount)
+	{
+		if (warmed >= LINK_DNS_PREFETCH_MAX_HOSTS)
+			break;
+		if (connected < LINK_PRECONNECT_MAX_HOSTS)
+		{
+			pool.preconnect(origin, isPrivate);
+			connected++;
+		}
+		else
+			pool.prefetchDns(origin, isPrivate);
+		warmed++;
+		linked++;
+	}
+
+	if (warmed > 0)
+		std::cout << "[BrocContainer] Warming " << warmed - linked << " hinted and "
+				  << linked << " linked hosts (of " << byCount.size() << ")"
+				  << std::endl;
+}
+
+std::string BrocContainer::linkAt(int x, int y)
+{
+	// same boxes that the link overlays are made from
+	for (auto& [html_link, overlay] : linkRegistry)
+	{
+		bool hit = false;
+		auto placement = html_link->get_placement();
+		if (placement.width > 0 && placement.height > 0)
+			hit = x >= placement.x && x < placement.right() && y >= placement.y && y < placement.bottom();
+		else
+		{
+			for (auto& [pos, sz] : get_draw_areas(html_link->m_renders))
+			{
+				if (x >= pos.x && x < pos.x + sz.width && y >= pos.y && y < pos.y + sz.height)
+				{
+					hit = true;
+					break;
+				}
+			}
+		}
+
+		const char* href = html_link->get_attr("href");
+		if (hit && href != nullptr && *href != '\0')
+			return resolve_url(href, "");
+	}
+	return "";
+}
+
 void BrocContainer::handleLinkClick(
 	const litehtml::element::ptr& link_element)
 {
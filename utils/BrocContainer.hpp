@@ -10,24 +10,61 @@
 #include "../libs/chesto/src/Element.hpp"
 #include "../libs/chesto/src/NetImageElement.hpp"
 #include "../src/WebView.hpp"
+#include "DisplayList.hpp"
+#include "Utils.hpp"
+
+class NetworkImage;
+
+// build with -DLAYOUT_BENCHMARK to have each layout timed and logged, with one
+// in this many text_width calls also measured the plain way, to report how
+// much layout time the glyph advance tables save
+#define TEXT_WIDTH_SAMPLE_RATE 64
 
 class BrocContainer : public litehtml::document_container
 {
 public:
 	BrocContainer(WebView* webView);
-	std::string base_url;	 // eg. https://site.com/path/to/page
-	std::string base_domain; // eg. https://site.com
-	std::string protocol;	 // eg. https
+	UrlBase base; // what relative urls on the page are resolved against
 	WebView* webView = NULL;
 
-	int eternalCounter = 0; // used for some incremental ids
-
-	// create a map to store all fonts on the page
-	std::map<litehtml::uint_ptr, CST_Font*> fontCache;
+#ifdef LAYOUT_BENCHMARK
+	// text_width benchmark for the current layout (see TEXT_WIDTH_SAMPLE_RATE)
+	struct TextWidthStats
+	{
+		int calls = 0;
+		int sampled = 0;
+		double cachedMs = 0; // of the sampled calls
+		double plainMs = 0;
+		int mismatches = 0;
+	} textWidthStats;
+#endif
+
+	// what the page draws, recorded again only after a layout (or a restyle,
+	// eg. :hover), replayed at the scroll position every frame
+	DisplayList displayList;
+	bool displayListDirty = true;
+	void recordDisplayList();
 
 	// create a map to store all images on the page
 	std::map<std::string, Texture*> imageCache;
 
+	// sizes from <img width=.. height=..> attributes, by resolved url, so layout
+	// has something to go on before the image itself arrives
+	std::map<std::string, litehtml::size> declaredImageSizes;
+
+	// <img> elements still downloading (or not yet started, if lazy), and where
+	// the page was scrolled when their fetches were last updated
+	struct PendingImage
+	{
+		litehtml::element::ptr element;
+		NetworkImage* image;
+		bool lazy;	// loading="lazy"
+		bool eager; // loading="eager"
+	};
+	std::vector<PendingImage> pendingImages;
+	bool imagePrioritiesDirty = true; // set after every layout
+	int prioritizedScrollY = 0;
+
 	// create a map to store HTML buttons mapped to invisible Chesto Element
 	// overlays
 	std::map<litehtml::element::ptr, Element*> buttonRegistry;
@@ -139,6 +176,8 @@ public:
 	void createChestoLinksFromHTML();
 	bool createChestoLinkFromElement(const litehtml::element::ptr& html_link);
 	void cleanupChestoLinks();
+	// the resolved href of the link at a point in the document, or empty
+	std::string linkAt(int x, int y);
 
 	// Event listener support methods
 	void addEventListener(const litehtml::element::ptr& element,
@@ -157,6 +196,16 @@ public:
 	void cleanupChestoEventListeners();
 
 	void cleanupAllOverlays(); // Clean up buttons, links, and event listeners
+
+	// start image downloads as they come within the lazy load margin, and move
+	// them up or down the request queue depending on how close they are to the
+	// viewport, call after drawing
+	void prioritizeImages();
+
+	// resolve the hosts this page links to ahead of time, and open connections
+	// to the most linked ones (plus any dns-prefetch/preconnect hints), once
+	bool linkHostsWarmed = false;
+	void warmLinkHosts();
 	virtual void
 	get_media_features(litehtml::media_features& media) const override;
 	virtual void get_language(litehtml::string& language,
@@ -0,0 +1,261 @@
+#include "ConnectionPool.hpp"
+#include "NetworkWorker.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+ConnectionPool& ConnectionPool::getInstance()
+{
+	static ConnectionPool instance;
+	return instance;
+}
+
+void ConnectionPool::init()
+{
+#ifndef NETWORK_MOCK
+	if (share != nullptr)
+		return;
+
+	share = createShare(locks);
+	privateShare = createShare(privateLocks);
+
+	loadTlsSessions();
+#endif
+}
+
+void ConnectionPool::cleanup()
+{
+#ifndef NETWORK_MOCK
+	// (sessions are saved along with the rest of the state when quitting)
+	logStats();
+	for (auto shared : { &share, &privateShare })
+	{
+		if (*shared != nullptr)
+			curl_share_cleanup(*shared);
+		*shared = nullptr;
+	}
+#endif
+}
+
+#ifndef NETWORK_MOCK
+CURLSH* ConnectionPool::createShare(std::mutex* locks)
+{
+	CURLSH* created = curl_share_init();
+
+	// handles live on both the main thread and the worker, so guard the share
+	curl_share_setopt(created, CURLSHOPT_LOCKFUNC, lockShare);
+	curl_share_setopt(created, CURLSHOPT_UNLOCKFUNC, unlockShare);
+	curl_share_setopt(created, CURLSHOPT_USERDATA, locks);
+
+	// connections themselves can't be shared across threads, those stay pooled
+	// in the worker's multi handle instead
+	curl_share_setopt(created, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(created, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	return created;
+}
+
+void ConnectionPool::lockShare(CURL* handle, curl_lock_data data,
+	curl_lock_access access, void* userptr)
+{
+	((std::mutex*)userptr)[data].lock();
+}
+
+void ConnectionPool::unlockShare(CURL* handle, curl_lock_data data,
+	void* userptr)
+{
+	((std::mutex*)userptr)[data].unlock();
+}
+
+void ConnectionPool::configureMulti(CURLM* multi)
+{
+	curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)POOL_MAX_CONNECTIONS);
+	curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)POOL_MAX_HOST_CONNECTIONS);
+	curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)POOL_MAX_IDLE_CONNECTIONS);
+
+	// multiplex over a single HTTP/2 connection where the server allows it
+	curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+}
+
+void ConnectionPool::attach(CURL* handle, bool isPrivate)
+{
+	CURLSH* shared = isPrivate ? privateShare : share;
+	if (shared != nullptr)
+		curl_easy_setopt(handle, CURLOPT_SHARE, shared);
+
+	curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, (long)POOL_DNS_CACHE_TIMEOUT);
+	curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+
+	// wait for an existing connection to free up (or multiplex) rather than
+	// opening yet another one to the same host
+	curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+}
+
+void ConnectionPool::recordTransfer(CURL* handle)
+{
+	long connects = 0;
+	curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+
+	curl_off_t appConnect = 0;
+	curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appConnect);
+
+	transfers++;
+	newConnections += connects;
+	if (connects > 0 && appConnect > 0)
+	{
+		// the handshake is what comes after the TCP connect
+		curl_off_t connect = 0;
+		curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+		auto handshake = std::max((curl_off_t)0, appConnect - connect);
+
+		tlsHandshakes++;
+		tlsHandshakeMicros += handshake;
+
+		char* url = nullptr;
+		curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+		std::cout << "[ConnectionPool] TLS handshake took " << handshake / 1000
+				  << "ms (" << (url ? url : "?") << ")" << std::endl;
+	}
+}
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+// the file is a list of sessions, each one: its expiry (8 bytes), then the
+// salted host hash and the session data, both prefixed by a 4 byte length
+static void appendBytes(std::string& out, const void* data, size_t length)
+{
+	out.append((const char*)data, length);
+}
+
+static CURLcode exportTlsSession(CURL* handle, void* userptr,
+	const char* session_key, const unsigned char* shmac, size_t shmac_len,
+	const unsigned char* sdata, size_t sdata_len, curl_off_t valid_until,
+	int ietf_tls_id, const char* alpn, size_t earlydata_max)
+{
+	auto& out = *(std::string*)userptr;
+	int64_t expires = valid_until;
+	uint32_t hashLength = shmac_len, dataLength = sdata_len;
+	appendBytes(out, &expires, sizeof(expires));
+	appendBytes(out, &hashLength, sizeof(hashLength));
+	appendBytes(out, shmac, shmac_len);
+	appendBytes(out, &dataLength, sizeof(dataLength));
+	appendBytes(out, sdata, sdata_len);
+	return CURLE_OK;
+}
+#endif
+#endif
+
+void ConnectionPool::loadTlsSessions()
+{
+#if !defined(NETWORK_MOCK) && LIBCURL_VERSION_NUM >= 0x080c00
+	auto saved = readFile(POOL_TLS_SESSIONS_PATH);
+	if (saved.empty() || share == nullptr)
+		return;
+
+	// sessions are imported through a handle into the share it's attached to
+	CURL* handle = curl_easy_init();
+	curl_easy_setopt(handle, CURLOPT_SHARE, share);
+
+	int restored = 0;
+	size_t pos = 0;
+	auto now = time(NULL);
+	auto read = [&](void* into, size_t length)
+	{
+		if (pos + length > saved.size())
+			return false;
+		memcpy(into, saved.data() + pos, length);
+		pos += length;
+		return true;
+	};
+
+	int64_t expires;
+	uint32_t hashLength, dataLength;
+	while (read(&expires, sizeof(expires)) && read(&hashLength, sizeof(hashLength)))
+	{
+		size_t hashAt = pos;
+		pos += hashLength;
+		if (!read(&dataLength, sizeof(dataLength)) || pos + dataLength > saved.size())
+			break;
+		size_t dataAt = pos;
+		pos += dataLength;
+
+		if (expires <= now)
+			continue;
+		if (curl_easy_ssls_import(handle, NULL,
+				(const unsigned char*)saved.data() + hashAt, hashLength,
+				(const unsigned char*)saved.data() + dataAt, dataLength)
+			== CURLE_OK)
+			restored++;
+	}
+
+	curl_easy_cleanup(handle);
+	std::cout << "[ConnectionPool] Restored " << restored << " TLS sessions"
+			  << std::endl;
+#endif
+}
+
+void ConnectionPool::saveTlsSessions()
+{
+#if !defined(NETWORK_MOCK) && LIBCURL_VERSION_NUM >= 0x080c00
+	if (share == nullptr)
+		return;
+
+	CURL* handle = curl_easy_init();
+	curl_easy_setopt(handle, CURLOPT_SHARE, share);
+
+	std::string out;
+	if (curl_easy_ssls_export(handle, exportTlsSession, &out) == CURLE_OK)
+		writeFile(POOL_TLS_SESSIONS_PATH, out);
+	curl_easy_cleanup(handle);
+#endif
+}
+
+void ConnectionPool::prefetchDns(const std::string& origin, bool isPrivate)
+{
+	auto& resolved = resolvedAt[isPrivate];
+	auto now = time(NULL);
+	auto last = resolved.find(origin);
+	if (last != resolved.end() && now - last->second < POOL_DNS_CACHE_TIMEOUT)
+		return;
+	resolved[origin] = now;
+	dnsPrefetches++;
+
+	auto request = std::make_shared<NetRequest>();
+	request->url = origin + "/";
+	request->isPrivate = isPrivate;
+	request->resolveOnly = true;
+	NetworkWorker::getInstance().submit(request);
+}
+
+void ConnectionPool::preconnect(const std::string& origin, bool isPrivate)
+{
+	auto& connected = connectedAt[isPrivate];
+	auto now = time(NULL);
+	auto last = connected.find(origin);
+	if (last != connected.end() && now - last->second < POOL_PRECONNECT_TIMEOUT)
+		return;
+	connected[origin] = now;
+	resolvedAt[isPrivate][origin] = now;
+	preconnects++;
+
+	// a HEAD of the root is about the cheapest request that leaves a connection
+	// (and TLS session) behind in the worker's pool
+	auto request = std::make_shared<NetRequest>();
+	request->url = origin + "/";
+	request->isPrivate = isPrivate;
+	request->headOnly = true;
+	NetworkWorker::getInstance().submit(request);
+}
+
+void ConnectionPool::logStats()
+{
+	std::cout << "[ConnectionPool] " << transfers << " transfers, "
+			  << newConnections << " new connections, " << tlsHandshakes
+			  << " TLS handshakes";
+	if (tlsHandshakes > 0)
+		std::cout << " (" << tlsHandshakeMicros / tlsHandshakes / 1000
+				  << "ms average)";
+	std::cout << ", " << dnsPrefetches << " DNS prefetches, "
+			  << preconnects << " preconnects" << std::endl;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef NETWORK_MOCK
+#include <curl/curl.h>
+#endif
+
+#include <atomic>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+
+// total sockets the worker keeps open at once, and how many of those can go to
+// a single host (more than this and curl queues the transfer)
+#define POOL_MAX_CONNECTIONS 8
+#define POOL_MAX_HOST_CONNECTIONS 4
+// how many idle keep-alive connections are kept around for re-use
+#define POOL_MAX_IDLE_CONNECTIONS 16
+// seconds a resolved address stays in the shared DNS cache
+#define POOL_DNS_CACHE_TIMEOUT 300
+// seconds a warmed up connection is assumed to still be around in the pool
+#define POOL_PRECONNECT_TIMEOUT 60
+// where TLS session tickets are kept between launches
+#define POOL_TLS_SESSIONS_PATH "./data/tls_sessions.bin"
+
+// Owns the curl share objects that let every handle re-use DNS lookups and TLS
+// sessions, and configures the worker's multi handle as the one bounded
+// connection pool that all fetches (pages, CSS, images) go through. Private
+// browsing gets a share of its own, which is never written to disk.
+class ConnectionPool
+{
+public:
+	static ConnectionPool& getInstance();
+
+	void init();
+	void cleanup();
+
+#ifndef NETWORK_MOCK
+	// apply the pool limits to a multi handle
+	void configureMulti(CURLM* multi);
+
+	// make an easy handle use the shared DNS/TLS state (of private browsing,
+	// or of everything else)
+	void attach(CURL* handle, bool isPrivate);
+
+	// after a transfer finishes, tally whether it needed a new connection
+	void recordTransfer(CURL* handle);
+#endif
+
+	// main thread: look up an origin's host ahead of time (into the shared DNS
+	// cache), or go as far as opening a connection that later requests re-use.
+	// Origins that were warmed up recently are skipped.
+	void prefetchDns(const std::string& origin, bool isPrivate);
+	void preconnect(const std::string& origin, bool isPrivate);
+
+	// TLS session tickets outlive the process, so a cold start can resume with
+	// hosts it has talked to before instead of doing a full handshake (this
+	// needs curl 8.12 or newer, older ones just start without them). Only the
+	// shared sessions are saved, private ones go away with the process.
+	void loadTlsSessions();
+	void saveTlsSessions();
+
+	void logStats();
+
+	std::atomic<int> transfers { 0 };
+	std::atomic<int> newConnections { 0 };
+	std::atomic<int> tlsHandshakes { 0 };
+	std::atomic<long long> tlsHandshakeMicros { 0 }; // all of them together
+	int dnsPrefetches = 0;
+	int preconnects = 0;
+
+private:
+	ConnectionPool() = default;
+
+	// origin -> when it was last resolved / connected to, main thread only
+	// (indexed by isPrivate, the two shares don't see each other's lookups)
+	std::map<std::string, time_t> resolvedAt[2];
+	std::map<std::string, time_t> connectedAt[2];
+
+#ifndef NETWORK_MOCK
+	CURLSH* share = nullptr;
+	CURLSH* privateShare = nullptr;
+	std::mutex locks[CURL_LOCK_DATA_LAST];
+	std::mutex privateLocks[CURL_LOCK_DATA_LAST];
+
+	static CURLSH* createShare(std::mutex* locks);
+	static void lockShare(CURL* handle, curl_lock_data data,
+		curl_lock_access access, void* userptr);
+	static void unlockShare(CURL* handle, curl_lock_data data, void* userptr);
+#endif
+};
@@ -0,0 +1,256 @@
+#include "DisplayList.hpp"
+#include "../libs/chesto/src/RootDisplay.hpp"
+#include "FontCache.hpp"
+#include "TextRenderer.hpp"
+#include "TileCache.hpp"
+#include "Utils.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+DisplayList::~DisplayList()
+{
+	TileCache::getInstance().drop(this);
+}
+
+void DisplayList::clear()
+{
+	items.clear();
+	boxes.clear();
+	runs.clear();
+	text.clear();
+	images.clear();
+	clips.clear();
+	tileHashes.clear();
+	document = nullptr;
+}
+
+void DisplayList::add(Kind kind, uint32_t index, float x, float y, float w, float h)
+{
+	items.push_back({ kind, index, y, y + h, x, x + w });
+}
+
+// boxes are drawn out to x + w and y + h inclusive (SDL_gfx corners, as the
+// container always passed them), so they cover one more pixel than their size
+void DisplayList::addFill(float x, float y, float w, float h, int radius, SDL_Color color)
+{
+	add(FILL, (uint32_t)boxes.size(), x, y, w + 1, h + 1);
+	boxes.push_back({ x, y, w, h, radius, color });
+}
+
+void DisplayList::addBorder(float x, float y, float w, float h, int radius, SDL_Color color)
+{
+	add(BORDER, (uint32_t)boxes.size(), x, y, w + 1, h + 1);
+	boxes.push_back({ x, y, w, h, radius, color });
+}
+
+void DisplayList::addText(CachedFont* font, const char* run, float x, float y, SDL_Color color)
+{
+	add(TEXT, (uint32_t)runs.size(), x, y, (float)font->textWidth(run), (float)font->height);
+	runs.push_back({ font, (uint32_t)text.size(), x, y, color });
+	text += run;
+	text += '\0';
+}
+
+void DisplayList::addImage(Texture* image, float x, float y, float w, float h, bool front)
+{
+	images.push_back({ image, x, y, w, h, front });
+}
+
+void DisplayList::pushClip(float x, float y, float w, float h)
+{
+	add(PUSH_CLIP, (uint32_t)clips.size(), x, y, w, h);
+	clips.push_back({ x, y, w, h });
+}
+
+void DisplayList::popClip()
+{
+	add(POP_CLIP, 0, 0, 0, 0, 0);
+}
+
+// FNV-1a, a word at a time
+static uint64_t mix(uint64_t hash, uint64_t value)
+{
+	return (hash ^ value) * 0x100000001b3ull;
+}
+
+static uint64_t bits(float value)
+{
+	uint32_t word;
+	memcpy(&word, &value, sizeof(word));
+	return word;
+}
+
+static uint64_t bits(SDL_Color color)
+{
+	return color.r | color.g << 8 | color.b << 16 | (uint64_t)color.a << 24;
+}
+
+static uint64_t tileKey(int col, int row)
+{
+	return (uint64_t)(uint32_t)col << 32 | (uint32_t)row;
+}
+
+uint64_t DisplayList::hashItem(const Item& item) const
+{
+	uint64_t hash = mix(0xcbf29ce484222325ull, item.kind);
+	hash = mix(hash, bits(item.left));
+	hash = mix(hash, bits(item.top));
+	hash = mix(hash, bits(item.right));
+	hash = mix(hash, bits(item.bottom));
+
+	if (item.kind == TEXT)
+	{
+		auto& run = runs[item.index];
+		hash = mix(hash, run.font->id);
+		hash = mix(hash, bits(run.color));
+		hash = mix(hash, std::hash<std::string_view>()(text.c_str() + run.offset));
+	}
+	else
+	{
+		auto& box = boxes[item.index];
+		hash = mix(hash, box.radius);
+		hash = mix(hash, bits(box.color));
+	}
+	return hash;
+}
+
+void DisplayList::hashTiles(int size)
+{
+	tileHashes.clear();
+	for (auto& item : items)
+	{
+		if (item.kind == PUSH_CLIP || item.kind == POP_CLIP || item.right <= item.left || item.bottom <= item.top)
+			continue;
+
+		// in paint order, so that a tile changes if its items are reordered
+		uint64_t hash = hashItem(item);
+		int firstCol = (int)std::floor(item.left / size), lastCol = (int)std::ceil(item.right / size) - 1;
+		int firstRow = (int)std::floor(item.top / size), lastRow = (int)std::ceil(item.bottom / size) - 1;
+		for (int row = firstRow; row <= lastRow; row++)
+		{
+			for (int col = firstCol; col <= lastCol; col++)
+			{
+				auto& tile = tileHashes[tileKey(col, row)];
+				tile = mix(tile == 0 ? 0xcbf29ce484222325ull : tile, hash);
+			}
+		}
+	}
+}
+
+uint64_t DisplayList::tileHash(int col, int row) const
+{
+	auto tile = tileHashes.find(tileKey(col, row));
+	return tile != tileHashes.end() ? tile->second : 0;
+}
+
+void DisplayList::placeImages(int offsetX)
+{
+	for (auto& ref : images)
+	{
+		ref.image->setPosition(offsetX + ref.x, ref.y);
+		ref.image->setSize(ref.w, ref.h);
+
+		// if it's not a background attachment, move it to the front
+		if (ref.front)
+			ref.image->moveToFront();
+	}
+}
+
+void DisplayList::drawText(const TextRun& run, int x, int y)
+{
+	const char* string = text.c_str() + run.offset;
+	float left = run.x + x, top = run.y + y;
+
+	// batched with the rest of the page's text (see TextRenderer)
+	if (TextRenderer::getInstance().queue(run.font, string, left, top, run.color))
+		return;
+
+	auto renderer = RootDisplay::mainDisplay->renderer;
+	auto font = run.font->font;
+	auto& color = run.color;
+	if (color.r != 0 || color.g != 0 || color.b != 0)
+	{
+		// color font! create an effect and use that to draw
+		auto align = FC_ALIGN_LEFT;
+		auto effect = FC_MakeEffect(
+			align, FC_MakeScale(1, 1),
+			CST_MakeColor(color.r, color.g, color.b, color.a));
+		FC_DrawEffect(font, renderer, left, top, effect, string);
+	}
+	else
+	{
+		CST_DrawFont(font, renderer, left, top, string);
+	}
+}
+
+void DisplayList::replay(int x, int y, int width, int height)
+{
+	auto renderer = RootDisplay::mainDisplay->renderer;
+	auto& textRenderer = TextRenderer::getInstance();
+	replays++;
+
+	// the viewport, in document coordinates
+	float top = -y, bottom = height - y;
+	float left = -x, right = width - x;
+
+	for (auto& item : items)
+	{
+		if (item.kind == PUSH_CLIP || item.kind == POP_CLIP)
+		{
+			// recorded in order, but the container never clipped (set_clip
+			// was a no-op before there was a display list), so neither does
+			// this yet
+			continue;
+		}
+
+		if (item.bottom <= top || item.top >= bottom || item.right <= left || item.left >= right)
+		{
+			culled++;
+			continue;
+		}
+		drawn++;
+
+		if (item.kind == TEXT)
+		{
+			drawText(runs[item.index], x, y);
+			continue;
+		}
+
+		// any text so far goes under it
+		textRenderer.flush();
+
+		auto& box = boxes[item.index];
+		int x1 = (int)box.x + x, y1 = (int)box.y + y;
+		int x2 = x1 + (int)box.w, y2 = y1 + (int)box.h;
+		auto& color = box.color;
+		if (item.kind == FILL)
+			CST_roundedBoxRGBA(renderer, x1, y1, x2, y2, box.radius,
+				color.r, color.g, color.b, color.a);
+		else
+			CST_roundedRectangleRGBA(renderer, x1, y1, x2, y2, box.radius,
+				color.r, color.g, color.b, color.a);
+	}
+
+	textRenderer.flush();
+}
+
+void DisplayList::logStats()
+{
+	if (replays == 0)
+		return;
+
+	int drawnPerFrame = (int)(drawn / replays);
+	std::cout << "[DisplayList] " << recordings << " recording" << plural(recordings)
+			  << " (" << recordMs << "ms), " << replays << " replay" << plural(replays) << ", "
+			  << drawnPerFrame << " item" << plural(drawnPerFrame) << " drawn and "
+			  << culled / replays << " culled per replay" << std::endl;
+
+	recordings = 0;
+	recordMs = 0;
+	replays = 0;
+	drawn = 0;
+	culled = 0;
+}
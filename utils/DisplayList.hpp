@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../libs/chesto/src/Texture.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CachedFont;
+
+// What a page draws, recorded once per layout (in document coordinates) by
+// walking the render tree, and replayed every frame at the scroll position.
+// Replaying skips whatever is outside the viewport, so scrolling costs a
+// translate and a bounds check per item rather than another walk of the tree.
+// Everything lives in flat arrays, the items only index into them.
+class DisplayList
+{
+public:
+	~DisplayList();
+
+	enum Kind : uint8_t
+	{
+		FILL,
+		BORDER,
+		TEXT,
+		PUSH_CLIP,
+		POP_CLIP,
+	};
+
+	// recording (from the document_container draw callbacks)
+	void clear();
+	void addFill(float x, float y, float w, float h, int radius, SDL_Color color);
+	void addBorder(float x, float y, float w, float h, int radius, SDL_Color color);
+	void addText(CachedFont* font, const char* text, float x, float y, SDL_Color color);
+	void addImage(Texture* image, float x, float y, float w, float h, bool front);
+	void pushClip(float x, float y, float w, float h);
+	void popClip();
+
+	// images are elements of their own (which scroll with the page), so they're
+	// only put in place once per recording, relative to offsetX
+	void placeImages(int offsetX);
+
+	// draw whatever intersects the width x height viewport, with the document
+	// scrolled to x, y
+	void replay(int x, int y, int width, int height);
+
+	bool empty() const { return items.empty(); }
+	const void* document = nullptr; // what it was recorded from
+
+	// after recording, a hash of what's drawn in each size x size tile of the
+	// document, so a tile drawn from an older recording can tell if it's
+	// still the same (0 for a tile with nothing in it)
+	void hashTiles(int size);
+	uint64_t tileHash(int col, int row) const;
+
+	// counters for debugging
+	int recordings = 0;
+	double recordMs = 0; // walking the tree, all recordings
+	int replays = 0;
+	size_t drawn = 0;
+	size_t culled = 0;
+	void logStats();
+
+private:
+	struct Item
+	{
+		Kind kind;
+		uint32_t index; // into boxes, runs or clips, by kind
+		float top, bottom, left, right;
+	};
+	std::vector<Item> items; // in paint order
+
+	struct Box
+	{
+		float x, y, w, h;
+		int radius;
+		SDL_Color color;
+	};
+	std::vector<Box> boxes; // fills and borders
+
+	struct TextRun
+	{
+		CachedFont* font;
+		uint32_t offset; // into text
+		float x, y;
+		SDL_Color color;
+	};
+	std::vector<TextRun> runs;
+	std::string text; // every run's text, each terminated by a NUL
+
+	struct ImageRef
+	{
+		Texture* image;
+		float x, y, w, h;
+		bool front;
+	};
+	std::vector<ImageRef> images;
+
+	struct Clip
+	{
+		float x, y, w, h;
+	};
+	std::vector<Clip> clips;
+
+	std::unordered_map<uint64_t, uint64_t> tileHashes; // by column and row
+
+	void add(Kind kind, uint32_t index, float x, float y, float w, float h);
+	void drawText(const TextRun& run, int x, int y);
+	uint64_t hashItem(const Item& item) const;
+};
@@ -0,0 +1,433 @@
+#include "DownloadManager.hpp"
+#include "NetworkWorker.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+static std::string headerOf(const std::map<std::string, std::string>& headers,
+	const std::string& name)
+{
+	auto it = headers.find(name);
+	return it != headers.end() ? it->second : "";
+}
+
+static std::string lowercase(std::string value)
+{
+	std::transform(value.begin(), value.end(), value.begin(),
+		[](unsigned char c)
+		{ return std::tolower(c); });
+	return value;
+}
+
+// what's been written so far, including what's still coming in
+static size_t rangeDone(const DownloadRange& range)
+{
+	return range.done + (range.request != nullptr ? range.request->bytesReceived.load() : 0);
+}
+
+size_t Download::done() const
+{
+	size_t total = 0;
+	for (auto& range : ranges)
+		total += rangeDone(range);
+	return total;
+}
+
+DownloadManager& DownloadManager::getInstance()
+{
+	static DownloadManager instance;
+	return instance;
+}
+
+bool DownloadManager::isDownload(const std::map<std::string, std::string>& headers)
+{
+	if (lowercase(headerOf(headers, "content-disposition")).find("attachment") == 0)
+		return true;
+
+	auto contentType = lowercase(headerOf(headers, "content-type"));
+	contentType = contentType.substr(0, contentType.find(';'));
+
+	// anything litehtml (or the image container) can show, or that we can't tell
+	if (contentType.empty() || contentType.find("text/") == 0
+		|| contentType.find("image/") == 0)
+		return false;
+	for (auto shown : { "html", "xml", "json", "javascript" })
+	{
+		if (contentType.find(shown) != std::string::npos)
+			return false;
+	}
+	return true;
+}
+
+std::string DownloadManager::reservePath(const std::string& url,
+	const std::map<std::string, std::string>& headers)
+{
+	// the server's suggestion, otherwise the last part of the url
+	std::string name;
+	auto disposition = headerOf(headers, "content-disposition");
+	auto filename = disposition.find("filename=");
+	if (filename != std::string::npos)
+	{
+		name = disposition.substr(filename + 9);
+		name = name.substr(0, name.find(';'));
+		name.erase(std::remove(name.begin(), name.end(), '"'), name.end());
+	}
+	if (name.empty())
+	{
+		auto path = url.substr(0, url.find_first_of("?#"));
+		name = path.substr(path.find_last_of('/') + 1);
+	}
+
+	// nothing that could climb out of the downloads directory
+	for (char& c : name)
+	{
+		if (c == '/' || c == '\\' || c == ':' || (unsigned char)c < 0x20)
+			c = '_';
+	}
+	name.erase(0, name.find_first_not_of(". "));
+	if (name.empty())
+		name = "download";
+
+	// don't overwrite an earlier download (or one still coming in, or being saved)
+	auto dot = name.rfind('.');
+	auto stem = dot != std::string::npos && dot > 0 ? name.substr(0, dot) : name;
+	auto extension = dot != std::string::npos && dot > 0 ? name.substr(dot) : "";
+	auto path = std::string(DOWNLOAD_DIRECTORY "/") + name;
+	for (int copy = 1; std::filesystem::exists(path) || std::filesystem::exists(path + ".part")
+			|| saving.count(path) > 0; copy++)
+		path = std::string(DOWNLOAD_DIRECTORY "/") + stem + "-" + std::to_string(copy) + extension;
+	return path;
+}
+
+bool DownloadManager::open(Download& download, bool truncate)
+{
+	download.fd = ::open((download.path + ".part").c_str(),
+		O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+	return download.fd >= 0;
+}
+
+void DownloadManager::split(Download& download, bool acceptsRanges)
+{
+	download.ranges.clear();
+
+	int count = 1;
+	if (acceptsRanges && download.size >= DOWNLOAD_SPLIT_THRESHOLD)
+		count = DOWNLOAD_MAX_CONNECTIONS;
+
+	size_t each = download.size / count;
+	for (int x = 0; x < count; x++)
+	{
+		DownloadRange range;
+		range.start = x * each;
+		range.end = x == count - 1 ? download.size - 1 : range.start + each - 1;
+		if (download.size == 0)
+			range.end = 0;
+		download.ranges.push_back(range);
+	}
+}
+
+void DownloadManager::start(const std::string& url,
+	const std::map<std::string, std::string>& headers, bool isPrivate)
+{
+	auto download = std::make_unique<Download>();
+	download->url = url;
+	download->isPrivate = isPrivate;
+	download->path = reservePath(url, headers);
+
+	// Content-Length is of the encoded body if there's a Content-Encoding,
+	// which downloads ask not to get, so it can't be trusted then
+	if (headerOf(headers, "content-encoding").empty())
+		download->size = strtoull(headerOf(headers, "content-length").c_str(), NULL, 10);
+
+	download->validator = headerOf(headers, "etag");
+	if (download->validator.empty())
+		download->validator = headerOf(headers, "last-modified");
+	bool acceptsRanges = lowercase(headerOf(headers, "accept-ranges")).find("bytes") != std::string::npos;
+
+	if (!open(*download, true))
+	{
+		std::cout << "[DownloadManager] Can't write " << download->path << std::endl;
+		return;
+	}
+
+	split(*download, acceptsRanges && download->size > 0);
+	std::cout << "[DownloadManager] Downloading " << url << " to " << download->path
+			  << " (" << download->size << " bytes, " << download->ranges.size()
+			  << " connection" << plural(download->ranges.size()) << ")" << std::endl;
+
+	download->startTime = std::chrono::steady_clock::now();
+	if (downloads.empty())
+		lastReport = download->startTime;
+	for (size_t x = 0; x < download->ranges.size(); x++)
+		startRange(*download, download->ranges[x]);
+	writeState(*download);
+	downloads.push_back(std::move(download));
+}
+
+void DownloadManager::save(const std::string& url,
+	const std::map<std::string, std::string>& headers, std::string& body,
+	const std::shared_ptr<SpilledBody>& spilled)
+{
+	auto path = reservePath(url, headers);
+
+	// a body that went to disk is already in a file, just move it over
+	if (spilled != nullptr)
+	{
+		bool saved = std::rename(spilled->path.c_str(), path.c_str()) == 0;
+		std::cout << "[DownloadManager] " << (saved ? "Saved " : "Can't save ") << url
+				  << " to " << path << std::endl;
+		if (saved)
+			completed++;
+		return;
+	}
+
+	// otherwise it can be several MB, which is written out on the worker
+	saving.insert(path);
+	NetworkWorker::getInstance().runOnWorker(
+		[path, body = std::move(body)](NetRequest& job)
+		{ job.success = writeFile(path, body); },
+		[this, url, path](NetRequest& job)
+		{
+			saving.erase(path);
+			std::cout << "[DownloadManager] " << (job.success ? "Saved " : "Can't save ")
+					  << url << " to " << path << std::endl;
+			if (job.success)
+				completed++;
+		});
+}
+
+void DownloadManager::startRange(Download& download, DownloadRange& range)
+{
+	size_t from = range.start + range.done;
+	if (download.size > 0 && from > range.end)
+		return; // already all here
+
+	auto request = std::make_shared<NetRequest>();
+	request->url = download.url;
+	request->isPrivate = download.isPrivate;
+
+	// the worker writes (and closes) a descriptor of its own, so this one can
+	// be closed whenever without pulling the file out from under it
+	request->outFd = dup(download.fd);
+	request->outOffset = from;
+
+	if (from > 0 || download.ranges.size() > 1)
+	{
+		auto bytes = "Range: bytes=" + std::to_string(from) + "-"
+			+ (download.size > 0 ? std::to_string(range.end) : "");
+		request->requestHeaders.push_back(bytes);
+
+		// if the file changed since, this gets the whole new one (a 200) instead
+		if (!download.validator.empty())
+			request->requestHeaders.push_back("If-Range: " + download.validator);
+	}
+
+	auto owner = &download;
+	size_t index = &range - &download.ranges[0];
+	request->onComplete = [this, owner, index](NetRequest& response)
+	{ onRangeComplete(*owner, owner->ranges[index], response); };
+
+	range.request = request;
+	NetworkWorker::getInstance().submit(request);
+}
+
+void DownloadManager::onRangeComplete(Download& download, DownloadRange& range,
+	NetRequest& response)
+{
+	range.done += response.bytesReceived;
+	range.request = nullptr;
+
+	// the server ignored the range, or the file changed in the meantime
+	if (response.httpCode == 200 && !response.requestHeaders.empty())
+	{
+		std::cout << "[DownloadManager] " << download.url
+				  << " can't be resumed, starting over" << std::endl;
+		restart(download);
+		return;
+	}
+
+	bool complete = download.size > 0 ? range.start + range.done > range.end
+									  : response.success && response.httpCode == 200;
+	if (!complete)
+	{
+		// carry on from wherever it stopped
+		if (++range.retries > DOWNLOAD_MAX_RETRIES)
+		{
+			std::cout << "[DownloadManager] Giving up on " << download.url << " (HTTP "
+					  << response.httpCode << ")" << std::endl;
+			download.failed = true;
+			for (auto& other : download.ranges)
+				NetworkWorker::getInstance().cancel(other.request);
+
+			// nothing to resume next time either (the other ranges' descriptors
+			// still point at the .part, it just goes once they're closed)
+			std::remove((download.path + ".part").c_str());
+			std::remove((download.path + ".download").c_str());
+			return;
+		}
+		startRange(download, range);
+		return;
+	}
+
+	bool allDone = std::all_of(download.ranges.begin(), download.ranges.end(),
+		[&download](const DownloadRange& other)
+		{ return other.request == nullptr && (download.size == 0 || other.start + other.done > other.end); });
+	if (allDone)
+		finish(download);
+}
+
+void DownloadManager::restart(Download& download)
+{
+	for (auto& range : download.ranges)
+		NetworkWorker::getInstance().cancel(range.request);
+
+	// one plain request for the whole thing, it can't be split up either
+	download.size = 0;
+	download.validator.clear();
+	split(download, false);
+	download.startDone = download.lastDone = 0;
+	startRange(download, download.ranges[0]);
+	writeState(download);
+}
+
+void DownloadManager::finish(Download& download)
+{
+	auto seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - download.startTime).count();
+	size_t total = download.done();
+
+	// (a restart can leave a longer earlier attempt behind)
+	if (ftruncate(download.fd, (off_t)total) != 0)
+		std::cout << "[DownloadManager] Can't trim " << download.path << std::endl;
+	close(download.fd);
+	download.fd = -1;
+
+	std::rename((download.path + ".part").c_str(), download.path.c_str());
+	std::remove((download.path + ".download").c_str());
+
+	size_t fetched = total - download.startDone;
+	std::cout << "[DownloadManager] Finished " << download.path << ": " << fetched / 1024
+			  << "KB in " << seconds << "s (" << (seconds > 0 ? fetched / 1024 / seconds : 0)
+			  << "KB/s over " << download.ranges.size() << " connection"
+			  << plural(download.ranges.size()) << ")" << std::endl;
+	completed++;
+}
+
+void DownloadManager::writeState(const Download& download)
+{
+	// (a failed download's state is gone for good, see onRangeComplete)
+	if (download.isPrivate || download.failed)
+		return;
+
+	// url, size and validator on lines of their own, then "start end done" for
+	// every range
+	std::ostringstream out;
+	out << download.url << "\n"
+		<< download.size << "\n"
+		<< download.validator << "\n";
+	for (auto& range : download.ranges)
+		out << range.start << " " << range.end << " " << rangeDone(range) << "\n";
+	writeFile(download.path + ".download", out.str());
+}
+
+void DownloadManager::resumeAll()
+{
+	std::error_code error;
+	for (auto& entry : std::filesystem::directory_iterator(DOWNLOAD_DIRECTORY, error))
+	{
+		auto statePath = entry.path().string();
+		if (entry.path().extension() != ".download")
+			continue;
+
+		auto download = std::make_unique<Download>();
+		download->path = statePath.substr(0, statePath.size() - 9);
+
+		std::istringstream state(readFile(statePath));
+		std::string size;
+		std::getline(state, download->url);
+		std::getline(state, size);
+		std::getline(state, download->validator);
+		download->size = strtoull(size.c_str(), NULL, 10);
+
+		DownloadRange range;
+		while (state >> range.start >> range.end >> range.done)
+			download->ranges.push_back(range);
+
+		if (download->url.empty() || download->ranges.empty()
+			|| !std::filesystem::exists(download->path + ".part") || !open(*download, false))
+		{
+			std::remove(statePath.c_str());
+			continue;
+		}
+
+		std::cout << "[DownloadManager] Resuming " << download->path << " at "
+				  << download->done() << " of " << download->size << " bytes" << std::endl;
+		resumed++;
+
+		download->startTime = std::chrono::steady_clock::now();
+		download->startDone = download->lastDone = download->done();
+		lastReport = download->startTime;
+		bool allDone = true;
+		for (auto& range : download->ranges)
+		{
+			startRange(*download, range);
+			allDone &= range.request == nullptr;
+		}
+		if (allDone)
+			finish(*download);
+		else
+			downloads.push_back(std::move(download));
+	}
+}
+
+void DownloadManager::saveAll()
+{
+	for (auto& download : downloads)
+		writeState(*download);
+}
+
+void DownloadManager::report(Download& download, float seconds)
+{
+	size_t done = download.done();
+	download.bytesPerSecond = (done - download.lastDone) / seconds;
+	download.lastDone = done;
+
+	std::cout << "[DownloadManager] " << download.path << ": " << done / 1024 << "KB";
+	if (download.size > 0)
+		std::cout << " of " << download.size / 1024 << "KB (" << done * 100 / download.size << "%)";
+	std::cout << " at " << download.bytesPerSecond / 1024 << "KB/s" << std::endl;
+}
+
+void DownloadManager::update()
+{
+	// drop the finished and failed ones (their transfers are all over or cancelled)
+	for (auto it = downloads.begin(); it != downloads.end();)
+	{
+		auto& download = **it;
+		if (download.fd < 0 || download.failed)
+		{
+			if (download.fd >= 0)
+				close(download.fd);
+			it = downloads.erase(it);
+		}
+		else
+			++it;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	auto seconds = std::chrono::duration<float>(now - lastReport).count();
+	if (downloads.empty() || seconds * 1000 < DOWNLOAD_SAVE_INTERVAL_MS)
+		return;
+	lastReport = now;
+
+	for (auto& download : downloads)
+	{
+		report(*download, seconds);
+		writeState(*download);
+	}
+}
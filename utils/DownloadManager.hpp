@@ -0,0 +1,115 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+struct NetRequest;
+struct SpilledBody;
+
+#define DOWNLOAD_DIRECTORY "./data/downloads"
+
+// files at least this big are split into byte ranges fetched side by side (if
+// the server accepts ranges), at most this many at a time
+#define DOWNLOAD_SPLIT_THRESHOLD 0x400000
+#define DOWNLOAD_MAX_CONNECTIONS 4
+#define DOWNLOAD_MAX_RETRIES 3
+
+// how often progress is written out (so a restart resumes close to where it
+// left off) and logged
+#define DOWNLOAD_SAVE_INTERVAL_MS 1000
+
+// One byte range of a download, end is inclusive (or 0 if the size is unknown,
+// in which case there's only the one range)
+struct DownloadRange
+{
+	size_t start = 0;
+	size_t end = 0;
+	size_t done = 0; // bytes written from start onwards
+
+	std::shared_ptr<NetRequest> request;
+	int retries = 0;
+};
+
+struct Download
+{
+	std::string url;
+	std::string path; // where the finished file goes (with .part while it's coming in)
+	size_t size = 0;  // 0 if the server didn't say
+	std::string validator; // ETag or Last-Modified, so a resume can't mix versions
+	bool isPrivate = false; // not resumed after a restart
+
+	std::vector<DownloadRange> ranges;
+	int fd = -1;
+	bool failed = false;
+
+	// throughput, over the whole download and since the last report
+	std::chrono::steady_clock::time_point startTime;
+	size_t startDone = 0; // already there when this session picked it up
+	size_t lastDone = 0;
+	float bytesPerSecond = 0;
+
+	size_t done() const;
+};
+
+// Saves anything the browser can't display (by content type, or when the server
+// asks for an attachment) into ./data/downloads. Large files are fetched as
+// several Range requests at once, each written straight to its place in the
+// file on the network worker. Unfinished downloads are kept as a .part file
+// plus a .download file recording the ranges, and resume on the next start.
+// Main thread only.
+class DownloadManager
+{
+public:
+	static DownloadManager& getInstance();
+
+	// whether a response should be downloaded rather than shown
+	static bool isDownload(const std::map<std::string, std::string>& headers);
+
+	// download url, given the headers of a response for it that was abandoned
+	// as soon as they were in (they tell us the size and whether ranges work)
+	void start(const std::string& url,
+		const std::map<std::string, std::string>& headers, bool isPrivate);
+
+	// keep a response that already came in whole (eg. from the cache, or too
+	// small to notice in time), the body is taken and written out on the worker
+	void save(const std::string& url,
+		const std::map<std::string, std::string>& headers, std::string& body,
+		const std::shared_ptr<SpilledBody>& spilled);
+
+	// pick up the downloads left unfinished last time
+	void resumeAll();
+
+	// write out everyone's progress, eg. before quitting
+	void saveAll();
+
+	// main thread, every frame: retry failed ranges, report progress, finish up
+	void update();
+
+	bool isActive() const { return !downloads.empty(); }
+
+	// counters for debugging
+	int completed = 0;
+	int resumed = 0;
+
+private:
+	DownloadManager() = default;
+
+	std::vector<std::unique_ptr<Download>> downloads;
+	std::set<std::string> saving; // paths save() is still writing out
+	std::chrono::steady_clock::time_point lastReport;
+
+	std::string reservePath(const std::string& url,
+		const std::map<std::string, std::string>& headers);
+	bool open(Download& download, bool truncate);
+	void split(Download& download, bool acceptsRanges);
+	void startRange(Download& download, DownloadRange& range);
+	void onRangeComplete(Download& download, DownloadRange& range, NetRequest& response);
+	void restart(Download& download);
+	void finish(Download& download);
+	void writeState(const Download& download);
+	void report(Download& download, float seconds);
+};
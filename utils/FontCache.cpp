@@ -0,0 +1,214 @@
+#include "FontCache.hpp"
+#include "../libs/chesto/src/RootDisplay.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FONT_CACHE_MMAP
+#endif
+
+FontCache& FontCache::getInstance()
+{
+	static FontCache instance;
+	return instance;
+}
+
+const FontCache::FontFile* FontCache::file(const std::string& path)
+{
+	auto existing = files.find(path);
+	if (existing != files.end())
+		return &existing->second;
+
+	// kept for as long as the process runs, every size and style of a family
+	// reads from the same bytes
+	auto& file = files[path];
+#ifdef FONT_CACHE_MMAP
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped != MAP_FAILED)
+		{
+			file.data = mapped;
+			file.size = info.st_size;
+		}
+	}
+	if (fd >= 0)
+		close(fd);
+#endif
+
+	// no mmap (or not a regular file, eg. in a romfs), read it in instead
+	if (file.data == nullptr)
+	{
+		file.contents = readFile(path);
+		file.data = file.contents.data();
+		file.size = file.contents.size();
+	}
+	return &file;
+}
+
+CachedFont* FontCache::acquire(const std::string& path, int size, int style)
+{
+	auto key = path + "@" + std::to_string(size) + "/" + std::to_string(style);
+
+	auto existing = fonts.find(key);
+	if (existing != fonts.end())
+	{
+		auto& cached = existing->second;
+		if (cached.refs++ == 0)
+			unusedBytes -= cached.bytes;
+		cached.lastUse = ++useCounter;
+		hits++;
+		return &cached;
+	}
+
+	std::cout << "[FontCache] Loading " << path << " at " << size << "px" << std::endl;
+	misses++;
+
+	auto ttf = file(path);
+	auto font = CST_CreateFont();
+	auto renderer = RootDisplay::mainDisplay->renderer;
+	FC_LoadFont_RW(font, renderer, SDL_RWFromConstMem(ttf->data, (int)ttf->size), 1,
+		size, CST_MakeColor(0, 0, 0, 255), style);
+
+	auto& cached = fonts[key];
+	cached.key = key;
+	cached.id = ++nextId;
+	cached.font = font;
+	cached.ttf = TTF_OpenFontRW(SDL_RWFromConstMem(ttf->data, (int)ttf->size), 1, size);
+	if (cached.ttf != nullptr)
+		TTF_SetFontStyle(cached.ttf, style);
+	std::fill(std::begin(cached.asciiAdvances), std::end(cached.asciiAdvances), -1);
+
+	// 'A' for ascent, 'g' for descent
+	const char* sample = "Ag";
+	cached.ascent = FC_GetAscent(font, sample);
+	cached.descent = FC_GetDescent(font, sample);
+	cached.height = FC_GetHeight(font, sample);
+	cached.xHeight = CST_GetFontWidth(font, "x");
+
+	// its glyph cache is the bulk of it, an RGBA cell per character
+	cached.bytes = (size_t)cached.height * cached.height * FONT_CACHE_GLYPH_ESTIMATE * 4;
+	cached.refs = 1;
+	cached.lastUse = ++useCounter;
+	return &cached;
+}
+
+int CachedFont::measure(const char* glyph, size_t length)
+{
+	return CST_GetFontWidth(font, std::string(glyph, length).c_str());
+}
+
+size_t utf8Length(char lead)
+{
+	unsigned char c = lead;
+	return c < 0xc0 ? 1 : c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : 2;
+}
+
+int CachedFont::advance(const char* glyph, size_t length)
+{
+	unsigned char lead = *glyph;
+	if (length == 1 && lead < 0x80)
+	{
+		auto& advance = asciiAdvances[lead];
+		if (advance < 0)
+			advance = measure(glyph, 1);
+		return advance;
+	}
+
+	// keyed by the raw bytes, no need to decode them
+	uint32_t key = 0;
+	for (size_t x = 0; x < length; x++)
+		key = (key << 8) | (unsigned char)glyph[x];
+
+	auto known = advances.find(key);
+	if (known == advances.end())
+		known = advances.emplace(key, measure(glyph, length)).first;
+	return known->second;
+}
+
+int CachedFont::textWidth(const char* text)
+{
+	// plain ASCII (most words, on most pages) is a lookup per byte
+	int width = 0;
+	const unsigned char* c = (const unsigned char*)text;
+	for (; *c != '\0' && *c < 0x80; c++)
+	{
+		auto& advance = asciiAdvances[*c];
+		if (advance < 0)
+			advance = measure((const char*)c, 1);
+		width += advance;
+	}
+	if (*c == '\0')
+		return width;
+
+	// anything else goes by codepoint, which is slower, so keep the whole word
+	std::string word = text;
+	auto known = wordWidths.find(word);
+	if (known != wordWidths.end())
+		return known->second;
+
+	width = 0;
+	size_t length = word.size();
+	for (size_t x = 0; x < length;)
+	{
+		size_t size = std::min(utf8Length(word[x]), length - x);
+		width += advance(&word[x], size);
+		x += size;
+	}
+
+	if (wordWidths.size() >= FONT_WORD_CACHE_LIMIT)
+		wordWidths.clear();
+	wordWidths[word] = width;
+	return width;
+}
+
+void FontCache::release(CachedFont* font)
+{
+	if (font == nullptr || font->refs <= 0)
+		return;
+
+	if (--font->refs == 0)
+	{
+		unusedBytes += font->bytes;
+		evictToFit();
+	}
+}
+
+void FontCache::evictToFit()
+{
+	while (unusedBytes > FONT_CACHE_MEMORY_LIMIT)
+	{
+		// least recently used among the ones nobody holds
+		auto oldest = fonts.end();
+		for (auto it = fonts.begin(); it != fonts.end(); ++it)
+		{
+			if (it->second.refs == 0 && (oldest == fonts.end() || it->second.lastUse < oldest->second.lastUse))
+				oldest = it;
+		}
+		if (oldest == fonts.end())
+			return;
+
+		unusedBytes -= oldest->second.bytes;
+		FC_FreeFont(oldest->second.font);
+		if (oldest->second.ttf != nullptr)
+			TTF_CloseFont(oldest->second.ttf);
+		fonts.erase(oldest);
+		evictions++;
+	}
+}
+
+void FontCache::logStats()
+{
+	std::cout << "[FontCache] " << fonts.size() << " font" << plural(fonts.size())
+			  << " loaded, " << hits << " hit" << plural(hits) << ", " << misses
+			  << " miss" << (misses == 1 ? "" : "es") << ", " << evictions
+			  << " evicted" << std::endl;
+}
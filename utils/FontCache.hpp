@@ -0,0 +1,98 @@
+#pragma once
+
+#include "../libs/chesto/src/Texture.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+// roughly how much the fonts nobody is using can take up before the least
+// recently used ones are freed (each is estimated from its ASCII glyph cache)
+#define FONT_CACHE_MEMORY_LIMIT 0x800000
+#define FONT_CACHE_GLYPH_ESTIMATE 96
+
+// widths of words with characters past ASCII are remembered, up to this many
+// per font (then it starts over)
+#define FONT_WORD_CACHE_LIMIT 2048
+
+// A loaded font face, shared by every page that asks for the same one
+struct CachedFont
+{
+	std::string key;
+	uint32_t id = 0; // never reused, unlike the address
+	CST_Font* font = nullptr;
+	TTF_Font* ttf = nullptr; // the same face, for rendering single glyphs
+
+	// measured once, when it's loaded
+	int ascent = 0;
+	int descent = 0;
+	int height = 0;
+	int xHeight = 0;
+
+	int refs = 0;
+	size_t bytes = 0; // estimated
+	uint64_t lastUse = 0;
+
+	// the width of a run of text (no newlines), the same as CST_GetFontWidth
+	// gives but summed from each glyph's advance, measured the first time
+	// it's seen
+	int textWidth(const char* text);
+
+	// the advance of the one UTF-8 character at glyph
+	int advance(const char* glyph, size_t length);
+
+private:
+	int16_t asciiAdvances[128]; // -1 until measured
+	std::unordered_map<uint32_t, int> advances; // everything else, by its UTF-8 bytes
+	std::unordered_map<std::string, int> wordWidths;
+
+	friend class FontCache;
+	int measure(const char* glyph, size_t length);
+};
+
+// how many bytes the UTF-8 character starting with lead takes up
+size_t utf8Length(char lead);
+
+// Font faces by (file, size, style), loaded once for the whole process rather
+// than by every document and tab, from TTF files that are also only read (or
+// mapped) once. Faces are reference counted and the unused ones are kept
+// around, within FONT_CACHE_MEMORY_LIMIT, for the next page to pick up.
+// Text is rasterized in black and tinted when drawn, so color isn't part of
+// the key. Main thread only.
+class FontCache
+{
+public:
+	static FontCache& getInstance();
+
+	// the face for the ttf at path, with a reference for the caller
+	CachedFont* acquire(const std::string& path, int size, int style);
+
+	// drop a reference, the face stays cached until it's evicted
+	void release(CachedFont* font);
+
+	// counters for debugging
+	int hits = 0;
+	int misses = 0;
+	int evictions = 0;
+	void logStats();
+
+private:
+	FontCache() = default;
+
+	// a whole TTF file, mapped (or read in, where there's no mmap)
+	struct FontFile
+	{
+		const void* data = nullptr;
+		size_t size = 0;
+		std::string contents; // if it was read in
+	};
+	std::map<std::string, FontFile> files;
+	const FontFile* file(const std::string& path);
+
+	std::map<std::string, CachedFont> fonts;
+	size_t unusedBytes = 0; // of the fonts with no references
+	uint64_t useCounter = 0;
+	uint32_t nextId = 0;
+
+	void evictToFit();
+};
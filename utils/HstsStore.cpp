@@ -0,0 +1,179 @@
+#include "HstsStore.hpp"
+#include "Utils.hpp"
+
+#include <iostream>
+#include <sstream>
+
+#define HSTS_STORE_PATH "./data/hsts.txt"
+
+// a few hosts (and whole TLDs) that are on the browsers' HSTS preload lists
+static const struct
+{
+	const char* host;
+	bool includeSubdomains;
+} HSTS_PRELOAD[] = {
+	{ "app", true },
+	{ "dev", true },
+	{ "page", true },
+	{ "duckduckgo.com", true },
+	{ "github.com", true },
+	{ "wikipedia.org", true },
+	{ "wikimedia.org", true },
+	{ "paypal.com", true },
+	{ "twitter.com", true },
+};
+
+std::string hostFromUrl(const std::string& url)
+{
+	auto start = url.find("://");
+	if (start == std::string::npos)
+		return "";
+	start += 3;
+
+	auto end = url.find_first_of("/?#", start);
+	auto authority = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+	auto at = authority.rfind('@');
+	if (at != std::string::npos)
+		authority = authority.substr(at + 1);
+	auto colon = authority.find(':');
+	if (colon != std::string::npos)
+		authority = authority.substr(0, colon);
+
+	return toLower(authority);
+}
+
+HstsStore& HstsStore::getInstance()
+{
+	static HstsStore instance;
+	return instance;
+}
+
+void HstsStore::ensureLoaded()
+{
+	if (loaded)
+		return;
+	loaded = true;
+
+	for (auto& preload : HSTS_PRELOAD)
+		entries[preload.host] = { 0, preload.includeSubdomains };
+
+	// one "host expires includeSubdomains" per line
+	std::istringstream saved(readFile(HSTS_STORE_PATH));
+	std::string host;
+	long long expires;
+	int includeSubdomains;
+	auto now = time(NULL);
+	while (saved >> host >> expires >> includeSubdomains)
+	{
+		if (expires > now && !entries.count(host))
+			entries[host] = { (time_t)expires, includeSubdomains != 0 };
+	}
+}
+
+void HstsStore::save()
+{
+	std::ostringstream out;
+	for (auto& [host, entry] : entries)
+	{
+		if (entry.expires != 0)
+			out << host << " " << (long long)entry.expires << " "
+				<< (entry.includeSubdomains ? 1 : 0) << "\n";
+	}
+	writeFile(HSTS_STORE_PATH, out.str());
+}
+
+const HstsEntry* HstsStore::find(const std::string& host, time_t now)
+{
+	ensureLoaded();
+
+	// the host itself, then each parent domain that covers its subdomains
+	bool exact = true;
+	for (size_t pos = 0; pos != std::string::npos && pos < host.size();)
+	{
+		auto it = entries.find(host.substr(pos));
+		if (it != entries.end()
+			&& (exact || it->second.includeSubdomains)
+			&& (it->second.expires == 0 || it->second.expires > now))
+			return &it->second;
+
+		exact = false;
+		pos = host.find('.', pos);
+		if (pos != std::string::npos)
+			pos++;
+	}
+	return nullptr;
+}
+
+bool HstsStore::isSecureHost(const std::string& host)
+{
+	return !host.empty() && find(host, time(NULL)) != nullptr;
+}
+
+std::string HstsStore::upgrade(const std::string& url)
+{
+	if (url.rfind("http://", 0) != 0 || !isSecureHost(hostFromUrl(url)))
+		return url;
+
+	auto secure = "https://" + url.substr(7);
+
+	// an explicit port 80 goes along with the scheme
+	auto host = hostFromUrl(url);
+	auto port = secure.find(host + ":80");
+	if (port != std::string::npos)
+	{
+		auto after = port + host.size() + 3;
+		if (after == secure.size() || secure.find_first_of("/?#", after) == after)
+			secure.erase(port + host.size(), 3);
+	}
+
+	std::cout << "[HstsStore] Upgrading " << url << " to HTTPS" << std::endl;
+	return secure;
+}
+
+void HstsStore::learn(const std::string& url,
+	const std::map<std::string, std::string>& headers)
+{
+	// only believe the header when it came over a secure connection
+	if (url.rfind("https://", 0) != 0)
+		return;
+
+	auto header = headers.find("strict-transport-security");
+	if (header == headers.end())
+		return;
+
+	auto host = hostFromUrl(url);
+	auto value = toLower(header->second);
+	auto maxAgePos = value.find("max-age=");
+	if (host.empty() || maxAgePos == std::string::npos)
+		return;
+
+	auto start = maxAgePos + 8;
+	if (start < value.size() && value[start] == '"')
+		start++;
+	long long maxAge = atoll(value.c_str() + start);
+	bool includeSubdomains = value.find("includesubdomains") != std::string::npos;
+
+	ensureLoaded();
+	auto existing = entries.find(host);
+	if (existing != entries.end() && existing->second.expires == 0)
+		return; // preloaded, the header can't take that away
+
+	if (maxAge <= 0)
+	{
+		if (existing == entries.end())
+			return;
+		entries.erase(existing);
+	}
+	else
+	{
+		HstsEntry entry { time(NULL) + (time_t)maxAge, includeSubdomains };
+		if (existing != entries.end()
+			&& existing->second.includeSubdomains == entry.includeSubdomains
+			&& existing->second.expires / 86400 == entry.expires / 86400)
+			return; // nothing worth writing out again
+		entries[host] = entry;
+	}
+
+	save();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <string>
+
+struct HstsEntry
+{
+	time_t expires = 0; // 0 for the built-in preload list, which never expires
+	bool includeSubdomains = false;
+};
+
+// Hosts that told us (over HTTPS, with Strict-Transport-Security) or that are
+// known ahead of time to only be reachable securely. http:// urls for them are
+// upgraded before the first request, saving the usual redirect round trip.
+// Learned entries are kept in ./data/hsts.txt. Main thread only.
+class HstsStore
+{
+public:
+	static HstsStore& getInstance();
+
+	// the https:// version of url if its host is known to require it
+	std::string upgrade(const std::string& url);
+
+	// remember (or forget, for max-age=0) a host from a response's headers
+	void learn(const std::string& url,
+		const std::map<std::string, std::string>& headers);
+
+	bool isSecureHost(const std::string& host);
+
+private:
+	HstsStore() = default;
+
+	std::map<std::string, HstsEntry> entries; // by lowercase host
+	bool loaded = false;
+
+	void ensureLoaded();
+	void save();
+	const HstsEntry* find(const std::string& host, time_t now);
+};
+
+// lowercase host of an absolute url, without userinfo or port
+std::string hostFromUrl(const std::string& url);
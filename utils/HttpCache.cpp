@@ -0,0 +1,814 @@
+#include "HttpCache.hpp"
+#include "NetworkWorker.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <zlib.h>
+
+bool HttpCacheEntry::isFresh(time_t now) const
+{
+	return !noCache && now - storedAt < lifetime;
+}
+
+bool HttpCacheEntry::isUsableStale(time_t now) const
+{
+	return !noCache && now - storedAt < lifetime + staleWhileRevalidate;
+}
+
+static time_t parseHttpDate(const std::string& date)
+{
+#ifndef NETWORK_MOCK
+	if (date.empty())
+		return -1;
+	return curl_getdate(date.c_str(), NULL);
+#else
+	return -1;
+#endif
+}
+
+static std::string headerValue(const std::map<std::string, std::string>& headers,
+	const std::string& name)
+{
+	auto it = headers.find(name);
+	return it != headers.end() ? it->second : "";
+}
+
+// reads a "name=123" directive out of a Cache-Control value, or -1
+static long cacheControlValue(const std::string& cacheControl,
+	const std::string& name)
+{
+	auto pos = cacheControl.find(name + "=");
+	if (pos == std::string::npos)
+		return -1;
+	return atol(cacheControl.c_str() + pos + name.length() + 1);
+}
+
+// whether a body is worth deflating before storing it (images, fonts and
+// archives are already compressed)
+static bool isCompressible(const std::string& contentType)
+{
+	auto type = toLower(contentType);
+	return type.rfind("text/", 0) == 0
+		|| type.find("javascript") != std::string::npos
+		|| type.find("json") != std::string::npos
+		|| type.find("xml") != std::string::npos;
+}
+
+// curl decodes the Content-Encoding itself, so a response that only varies by
+// that is the same for every request we make. Anything else (eg. Cookie, or *)
+// could differ for the next one.
+static bool isCacheableVary(const std::string& vary)
+{
+	std::istringstream names(toLower(vary));
+	std::string name;
+	while (std::getline(names, name, ','))
+	{
+		name.erase(0, name.find_first_not_of(" \t"));
+		name.erase(name.find_last_not_of(" \t") + 1);
+		if (!name.empty() && name != "accept-encoding")
+			return false;
+	}
+	return true;
+}
+
+static bool deflateBody(const std::string& body, std::string& out)
+{
+	uLongf length = compressBound(body.size());
+	out.resize(length);
+	if (compress2((Bytef*)&out[0], &length, (const Bytef*)body.data(),
+			body.size(), Z_DEFAULT_COMPRESSION)
+		!= Z_OK)
+		return false;
+	out.resize(length);
+	return true;
+}
+
+static bool inflateBody(const std::string& stored, size_t decodedSize,
+	std::string& out)
+{
+	out.resize(decodedSize);
+	uLongf length = decodedSize;
+	if (uncompress((Bytef*)&out[0], &length, (const Bytef*)stored.data(),
+			stored.size())
+			!= Z_OK
+		|| length != decodedSize)
+		return false;
+	return true;
+}
+
+// turns urls into file names
+static std::string hashUrl(const std::string& url)
+{
+	char out[17];
+	snprintf(out, sizeof(out), "%016llx", (unsigned long long)hashString(url));
+	return out;
+}
+
+HttpCache& HttpCache::getInstance(bool isPrivate)
+{
+	static HttpCache diskCache("./data/cache", HTTP_CACHE_DISK_LIMIT);
+	static HttpCache memoryCache("", HTTP_CACHE_MEMORY_LIMIT);
+	return isPrivate ? memoryCache : diskCache;
+}
+
+HttpCache::HttpCache(const std::string& directory, size_t maxBytes)
+	: directory(directory)
+	, maxBytes(maxBytes)
+{
+}
+
+std::string HttpCache::pathFor(const std::string& url) const
+{
+	return directory + "/" + hashUrl(url);
+}
+
+void HttpCache::ensureLoaded()
+{
+	if (loaded || loading)
+		return;
+
+	if (directory.empty())
+	{
+		loaded = true;
+		return;
+	}
+
+	// rebuild the index from the .meta files on disk, on the worker (which only
+	// reads the directory, and that never changes). Fetches wait for it.
+	loading = true;
+	auto found = std::make_shared<std::vector<HttpCacheEntry>>();
+	NetworkWorker::getInstance().runOnWorker(
+		[this, found](NetRequest& job)
+		{
+			mkpath(directory);
+			std::error_code ec;
+			for (const auto& file : std::filesystem::directory_iterator(directory, ec))
+			{
+				if (file.path().extension() != ".meta")
+					continue;
+
+				HttpCacheEntry entry;
+				if (!readEntryMeta(file.path().string(), entry))
+				{
+					std::filesystem::remove(file.path(), ec);
+					continue;
+				}
+				found->push_back(std::move(entry));
+			}
+			job.success = true;
+		},
+		[this, found](NetRequest& job)
+		{
+			for (auto& entry : *found)
+			{
+				if (entries.count(entry.url))
+					continue;
+				totalBytes += entry.size;
+				entries[entry.url] = std::move(entry);
+			}
+			loading = false;
+			loaded = true;
+
+			std::cout << "[HttpCache] Loaded " << entries.size() << " entries ("
+					  << totalBytes / 1024 << "KB)" << std::endl;
+
+			auto waiting = std::move(deferred);
+			for (auto& fetch : waiting)
+			{
+				if (!fetch.request->cancelled)
+					resolve(fetch.request, fetch.revalidate, fetch.onComplete, fetch.onData);
+			}
+		});
+}
+
+HttpCacheEntry* HttpCache::lookup(const std::string& url)
+{
+	ensureLoaded();
+	auto it = entries.find(url);
+	return it != entries.end() ? &it->second : nullptr;
+}
+
+void HttpCache::updateFreshness(HttpCacheEntry& entry, time_t now)
+{
+	auto cacheControl = toLower(headerValue(entry.headers, "cache-control"));
+
+	entry.noCache = cacheControl.find("no-cache") != std::string::npos;
+	entry.lifetime = 0;
+	entry.staleWhileRevalidate = 0;
+
+	long maxAge = cacheControlValue(cacheControl, "max-age");
+	time_t date = parseHttpDate(headerValue(entry.headers, "date"));
+	if (date < 0)
+		date = now;
+
+	if (maxAge >= 0)
+	{
+		entry.lifetime = maxAge;
+	}
+	else if (entry.headers.count("expires"))
+	{
+		time_t expires = parseHttpDate(headerValue(entry.headers, "expires"));
+		entry.lifetime = std::max((time_t)0, expires - date);
+	}
+	else if (entry.headers.count("last-modified"))
+	{
+		// no explicit lifetime, use the usual 10% of the document's age (max a day)
+		time_t lastModified = parseHttpDate(headerValue(entry.headers, "last-modified"));
+		if (lastModified > 0 && lastModified < date)
+			entry.lifetime = std::min((time_t)86400, (date - lastModified) / 10);
+	}
+
+	if (cacheControl.find("must-revalidate") == std::string::npos)
+	{
+		long swr = cacheControlValue(cacheControl, "stale-while-revalidate");
+		if (swr > 0)
+			entry.staleWhileRevalidate = swr;
+	}
+}
+
+void HttpCache::addConditionalHeaders(NetRequest& request,
+	const HttpCacheEntry& entry)
+{
+	auto etag = entry.headers.find("etag");
+	if (etag != entry.headers.end())
+		request.requestHeaders.push_back("If-None-Match: " + etag->second);
+
+	auto lastModified = entry.headers.find("last-modified");
+	if (lastModified != entry.headers.end())
+		request.requestHeaders.push_back("If-Modified-Since: " + lastModified->second);
+}
+
+std::function<void(NetRequest&)> HttpCache::readWork(const HttpCacheEntry& entry)
+{
+	// the in-memory partition has nothing to read, but still goes through the
+	// worker to be inflated there
+	bool onDisk = !directory.empty();
+	auto base = onDisk ? pathFor(entry.url) : "";
+	auto stored = onDisk ? "" : entry.body;
+	size_t size = entry.size;
+	bool deflated = entry.deflated;
+	size_t decodedSize = entry.decodedSize;
+
+	return [onDisk, base, stored, size, deflated, decodedSize](NetRequest& read)
+	{
+		read.body = onDisk ? readFile(base + ".body") : stored;
+		read.success = read.body.size() == size;
+		if (read.success && deflated)
+		{
+			std::string body;
+			read.success = inflateBody(read.body, decodedSize, body);
+			read.body = std::move(body);
+		}
+
+		// the meta file's modification time doubles as the on-disk LRU order
+		if (onDisk && read.success)
+		{
+			std::error_code ec;
+			std::filesystem::last_write_time(base + ".meta",
+				std::filesystem::file_time_type::clock::now(), ec);
+		}
+	};
+}
+
+void HttpCache::serveStored(const std::shared_ptr<NetRequest>& waiter,
+	HttpCacheEntry& entry, std::function<void(NetRequest&)> onComplete,
+	std::function<void(NetRequest&)> onData)
+{
+	bool stale = !entry.isFresh(time(NULL));
+	touch(entry);
+
+	// (the body is the one thing a background revalidation doesn't need)
+	HttpCacheEntry served = entry;
+	served.body.clear();
+
+	waiter->headers = entry.headers;
+	waiter->httpCode = entry.status;
+	waiter->fromCache = true;
+	waiter->work = readWork(entry);
+	waiter->onComplete = [this, waiter, served, stale, onComplete, onData](NetRequest& response)
+	{
+		if (!response.success)
+		{
+			// body went missing or was corrupted, treat it as a miss
+			remove(response.url);
+			response.body.clear();
+			response.headers.clear();
+			response.httpCode = 0;
+			response.fromCache = false;
+			response.done = false;
+			misses++;
+			fetchFromNetwork(waiter, nullptr, onComplete, onData);
+			return;
+		}
+
+		if (stale)
+		{
+			// served the stale copy right away, now refresh it behind the scenes
+			staleHits++;
+			revalidateInBackground(served);
+		}
+		else
+			hits++;
+
+		if (onComplete)
+			onComplete(response);
+	};
+	NetworkWorker::getInstance().submit(waiter);
+}
+
+std::shared_ptr<NetRequest> HttpCache::fetch(const std::string& url,
+	bool revalidate, std::function<void(NetRequest&)> onComplete,
+	std::function<void(NetRequest&)> onData)
+{
+	// the caller's own view of the fetch, filled in once it completes
+	auto waiter = std::make_shared<NetRequest>();
+	waiter->url = url;
+	waiter->isPrivate = directory.empty();
+
+	ensureLoaded();
+	if (!loaded)
+		deferred.push_back({ waiter, revalidate, onComplete, onData });
+	else
+		resolve(waiter, revalidate, onComplete, onData);
+	return waiter;
+}
+
+void HttpCache::resolve(const std::shared_ptr<NetRequest>& waiter,
+	bool revalidate, std::function<void(NetRequest&)> onComplete,
+	std::function<void(NetRequest&)> onData)
+{
+	auto now = time(NULL);
+	auto entry = lookup(waiter->url);
+
+	// a stale copy that's still usable is served too, and refreshed afterwards
+	if (entry != nullptr && !revalidate && (entry->isFresh(now) || entry->isUsableStale(now)))
+	{
+		serveStored(waiter, *entry, onComplete, onData);
+		return;
+	}
+
+	if (entry == nullptr)
+		misses++;
+	fetchFromNetwork(waiter, entry, onComplete, onData);
+}
+
+void HttpCache::fetchFromNetwork(const std::shared_ptr<NetRequest>& waiter,
+	const HttpCacheEntry* entry, std::function<void(NetRequest&)> onComplete,
+	std::function<void(NetRequest&)> onData)
+{
+	auto& url = waiter->url;
+	auto running = inFlight.find(url);
+	if (running != inFlight.end())
+	{
+		std::cout << "[HttpCache] Joining in-flight fetch of " << url << std::endl;
+		coalesced++;
+		waiter->transfer = running->second.transfer.get();
+		running->second.waiters.push_back({ waiter, onComplete, onData });
+		return;
+	}
+
+	// only streams if the first caller wants it (later ones just complete)
+	auto request = startTransfer(url, entry, onData != nullptr);
+	waiter->transfer = request.get();
+	inFlight[url] = { request, { { waiter, onComplete, onData } } };
+}
+
+std::shared_ptr<NetRequest> HttpCache::startTransfer(const std::string& url,
+	const HttpCacheEntry* entry, bool streaming)
+{
+	auto request = std::make_shared<NetRequest>();
+	request->url = url;
+	request->isPrivate = directory.empty();
+	if (entry != nullptr)
+		addConditionalHeaders(*request, *entry);
+
+	request->onComplete = [this](NetRequest& response)
+	{
+		if (handleResponse(response))
+			completeWaiters(response);
+	};
+
+	if (streaming)
+	{
+		request->streaming = true;
+		request->onData = [this](NetRequest& transfer)
+		{ streamToWaiters(transfer); };
+	}
+
+	NetworkWorker::getInstance().submit(request);
+	return request;
+}
+
+void HttpCache::refetch(NetRequest& transfer)
+{
+	auto running = inFlight.find(transfer.url);
+	if (running == inFlight.end() || running->second.transfer.get() != &transfer)
+		return; // a background revalidation, nobody is waiting on it
+
+	auto& waiters = running->second.waiters;
+	bool streaming = std::any_of(waiters.begin(), waiters.end(),
+		[](const Waiter& waiter)
+		{ return waiter.onData != nullptr; });
+
+	std::cout << "[HttpCache] Refetching " << transfer.url << std::endl;
+	auto request = startTransfer(transfer.url, nullptr, streaming);
+	for (auto& waiter : waiters)
+		waiter.request->transfer = request.get();
+	running->second.transfer = request;
+}
+
+void HttpCache::streamToWaiters(NetRequest& transfer)
+{
+	auto running = inFlight.find(transfer.url);
+	if (running == inFlight.end())
+		return;
+
+	// (a copy, the callbacks may start or cancel other fetches)
+	auto waiters = running->second.waiters;
+	for (auto& waiter : waiters)
+	{
+		if (waiter.onData && !waiter.request->cancelled)
+			waiter.onData(transfer);
+	}
+}
+
+void HttpCache::completeWaiters(NetRequest& transfer)
+{
+	auto running = inFlight.find(transfer.url);
+	if (running == inFlight.end() || running->second.transfer.get() != &transfer)
+		return;
+
+	auto waiters = std::move(running->second.waiters);
+	inFlight.erase(running);
+
+	bool first = true;
+	for (size_t i = 0; i < waiters.size(); i++)
+	{
+		auto& request = *waiters[i].request;
+		request.transfer = nullptr;
+		if (request.cancelled)
+			continue;
+
+		// everyone gets a copy of the body, except the last, who can have it
+		bool last = std::none_of(waiters.begin() + i + 1, waiters.end(),
+			[](const Waiter& other)
+			{ return !other.request->cancelled; });
+		request.body = last ? std::move(transfer.body) : transfer.body;
+		request.spilled = transfer.spilled;
+		request.headers = transfer.headers;
+		request.httpCode = transfer.httpCode;
+		request.success = transfer.success;
+		request.bytesReceived = transfer.bytesReceived.load();
+		request.bytesOnWire = transfer.bytesOnWire.load();
+		request.bytesTotal = transfer.bytesTotal.load();
+
+		// only the caller that started the transfer paid for it
+		request.fromCache = transfer.fromCache || !first;
+		first = false;
+
+		request.done = true;
+		if (waiters[i].onComplete)
+			waiters[i].onComplete(request);
+	}
+}
+
+void HttpCache::cancel(const std::shared_ptr<NetRequest>& request)
+{
+	if (request == nullptr)
+		return;
+	NetworkWorker::getInstance().cancel(request);
+
+	auto running = inFlight.find(request->url);
+	if (running == inFlight.end())
+		return;
+
+	auto& waiters = running->second.waiters;
+	bool waiting = std::any_of(waiters.begin(), waiters.end(),
+		[&request](const Waiter& waiter)
+		{ return waiter.request == request; });
+	bool anyoneLeft = std::any_of(waiters.begin(), waiters.end(),
+		[](const Waiter& waiter)
+		{ return !waiter.request->cancelled; });
+	if (!waiting || anyoneLeft)
+		return;
+
+	// nobody wants it anymore, stop the transfer itself
+	for (auto& waiter : waiters)
+		waiter.request->transfer = nullptr;
+	NetworkWorker::getInstance().cancel(running->second.transfer);
+	inFlight.erase(running);
+}
+
+std::string HttpCache::validator(const std::string& url)
+{
+	auto entry = lookup(url);
+	if (entry == nullptr || !entry->isFresh(time(NULL)))
+		return "";
+
+	auto etag = entry->headers.find("etag");
+	if (etag != entry->headers.end())
+		return etag->second;
+	auto lastModified = entry->headers.find("last-modified");
+	if (lastModified != entry->headers.end())
+		return lastModified->second;
+
+	// no validators at all, but it's still the same stored response
+	return "stored " + std::to_string((long long)entry->storedAt);
+}
+
+void HttpCache::revalidateInBackground(const HttpCacheEntry& entry)
+{
+	auto request = std::make_shared<NetRequest>();
+	request->url = entry.url;
+	request->isPrivate = directory.empty();
+	addConditionalHeaders(*request, entry);
+	request->onComplete = [this](NetRequest& response)
+	{ handleResponse(response); };
+	NetworkWorker::getInstance().submit(request);
+}
+
+bool HttpCache::handleResponse(NetRequest& response)
+{
+	if (response.httpCode != 304)
+	{
+		store(response);
+		return true;
+	}
+
+	auto entry = lookup(response.url);
+	if (entry == nullptr)
+	{
+		// evicted while we were revalidating, so there's no body to go with
+		// the 304 and the callers need a full response instead
+		refetch(response);
+		return false;
+	}
+
+	// not modified: refresh the stored headers and hand back the cached body
+	revalidations++;
+	for (auto& [name, value] : response.headers)
+	{
+		if (name != "content-length" && name != "content-encoding" && name != "set-cookie")
+			entry->headers[name] = value;
+	}
+
+	auto now = time(NULL);
+	entry->storedAt = now;
+	updateFreshness(*entry, now);
+	writeEntryMeta(*entry);
+	touch(*entry);
+
+	// a background revalidation has nobody to hand the body to
+	auto running = inFlight.find(response.url);
+	if (running == inFlight.end() || running->second.transfer.get() != &response)
+		return false;
+
+	auto transfer = running->second.transfer;
+	HttpCacheEntry stored = *entry;
+	stored.body.clear();
+	NetworkWorker::getInstance().runOnWorker(readWork(*entry),
+		[this, transfer, stored](NetRequest& read)
+		{
+			if (!read.success)
+			{
+				// nothing usable to fall back on, ask again without the validators
+				remove(stored.url);
+				refetch(*transfer);
+				return;
+			}
+			transfer->body = std::move(read.body);
+			transfer->headers = stored.headers;
+			transfer->httpCode = stored.status;
+			transfer->fromCache = true;
+			completeWaiters(*transfer);
+		});
+	return false;
+}
+
+void HttpCache::store(NetRequest& response)
+{
+	// (bodies big enough to have gone to disk are too big to cache anyway)
+	if (!response.success || response.httpCode != 200 || response.spilled != nullptr)
+		return;
+
+	auto cacheControl = toLower(headerValue(response.headers, "cache-control"));
+	if (cacheControl.find("no-store") != std::string::npos
+		|| !isCacheableVary(headerValue(response.headers, "vary")))
+	{
+		remove(response.url);
+		return;
+	}
+
+	remove(response.url);
+
+	auto now = time(NULL);
+	auto entry = std::make_shared<HttpCacheEntry>();
+	entry->url = response.url;
+	entry->status = response.httpCode;
+	entry->decodedSize = response.body.size();
+	entry->lastAccess = now;
+
+	for (auto& [name, value] : response.headers)
+	{
+		// the stored body no longer matches the transfer's encoding or length
+		if (name != "set-cookie" && name != "content-encoding" && name != "content-length")
+			entry->headers[name] = value;
+	}
+
+	// a response that has been sitting in another cache is already this old
+	auto age = entry->headers.find("age");
+	entry->storedAt = now;
+	if (age != entry->headers.end())
+		entry->storedAt -= std::max(0L, atol(age->second.c_str()));
+	updateFreshness(*entry, now);
+
+	// compressed and written out on the worker, and only added to the index
+	// once it's there (unless it was removed or stored again in the meantime)
+	uint64_t generation = ++storeGeneration;
+	storing[entry->url] = generation;
+	bool onDisk = !directory.empty();
+	auto base = onDisk ? pathFor(entry->url) : "";
+	bool compressible = isCompressible(headerValue(response.headers, "content-type"));
+	size_t limit = maxBytes / 4;
+
+	NetworkWorker::getInstance().runOnWorker(
+		[entry, onDisk, base, compressible, limit, body = response.body](NetRequest& job)
+		{
+			// curl already undid the Content-Encoding, so re-compress text
+			// ourselves rather than keep the decoded copy around
+			std::string deflated;
+			entry->deflated = compressible && deflateBody(body, deflated)
+				&& deflated.size() < body.size();
+			const std::string& stored = entry->deflated ? deflated : body;
+			entry->size = stored.size();
+
+			// don't let one huge download flush out everything else
+			if (entry->size > limit)
+				return;
+
+			if (!onDisk)
+				entry->body = stored;
+			job.success = !onDisk
+				|| (writeFile(base + ".body", stored)
+					&& writeFile(base + ".meta", formatEntryMeta(*entry)));
+		},
+		[this, entry, generation](NetRequest& job)
+		{
+			auto pending = storing.find(entry->url);
+			if (pending == storing.end() || pending->second != generation)
+				return;
+			storing.erase(pending);
+			if (!job.success)
+			{
+				removeFiles(entry->url);
+				return;
+			}
+
+			evictToFit(entry->size);
+			storedBytes += entry->size;
+			decodedBytes += entry->decodedSize;
+			totalBytes += entry->size;
+			entries[entry->url] = std::move(*entry);
+		});
+}
+
+void HttpCache::remove(const std::string& url)
+{
+	// (a store still being written out is no longer wanted either)
+	bool known = storing.erase(url) > 0;
+
+	auto it = entries.find(url);
+	if (it != entries.end())
+	{
+		totalBytes -= it->second.size;
+		entries.erase(it);
+		known = true;
+	}
+
+	if (known)
+		removeFiles(url);
+}
+
+void HttpCache::removeFiles(const std::string& url)
+{
+	if (directory.empty())
+		return;
+
+	auto base = pathFor(url);
+	NetworkWorker::getInstance().runOnWorker(
+		[base](NetRequest& job)
+		{
+			std::remove((base + ".meta").c_str());
+			std::remove((base + ".body").c_str());
+			job.success = true;
+		});
+}
+
+void HttpCache::evictToFit(size_t incoming)
+{
+	while (!entries.empty() && totalBytes + incoming > maxBytes)
+	{
+		// drop the least recently used entry
+		auto oldest = std::min_element(entries.begin(), entries.end(),
+			[](const auto& a, const auto& b)
+			{ return a.second.lastAccess < b.second.lastAccess; });
+		std::cout << "[HttpCache] Evicting " << oldest->first << std::endl;
+		remove(oldest->first);
+	}
+}
+
+void HttpCache::clear()
+{
+	while (!storing.empty())
+		remove(storing.begin()->first);
+	while (!entries.empty())
+		remove(entries.begin()->first);
+}
+
+void HttpCache::touch(HttpCacheEntry& entry)
+{
+	// (on disk, reading the body bumps the meta file's time, see readWork)
+	entry.lastAccess = time(NULL);
+}
+
+std::string HttpCache::formatEntryMeta(const HttpCacheEntry& entry)
+{
+	std::ostringstream meta;
+	meta << "url " << entry.url << "\n";
+	meta << "status " << entry.status << "\n";
+	meta << "stored " << (long long)entry.storedAt << "\n";
+	meta << "size " << entry.size << "\n";
+	if (entry.deflated)
+		meta << "deflated " << entry.decodedSize << "\n";
+	for (auto& [name, value] : entry.headers)
+		meta << "header " << name << ": " << value << "\n";
+	return meta.str();
+}
+
+void HttpCache::writeEntryMeta(const HttpCacheEntry& entry)
+{
+	if (directory.empty())
+		return;
+
+	auto path = pathFor(entry.url) + ".meta";
+	auto meta = formatEntryMeta(entry);
+	NetworkWorker::getInstance().runOnWorker(
+		[path, meta](NetRequest& job)
+		{ job.success = writeFile(path, meta); });
+}
+
+bool HttpCache::readEntryMeta(const std::string& path, HttpCacheEntry& entry) const
+{
+	std::istringstream meta(readFile(path));
+	std::string line;
+	while (std::getline(meta, line))
+	{
+		auto space = line.find(' ');
+		if (space == std::string::npos)
+			continue;
+		auto key = line.substr(0, space);
+		auto value = line.substr(space + 1);
+
+		if (key == "url")
+			entry.url = value;
+		else if (key == "status")
+			entry.status = atoi(value.c_str());
+		else if (key == "stored")
+			entry.storedAt = (time_t)atoll(value.c_str());
+		else if (key == "size")
+			entry.size = (size_t)atoll(value.c_str());
+		else if (key == "deflated")
+		{
+			entry.deflated = true;
+			entry.decodedSize = (size_t)atoll(value.c_str());
+		}
+		else if (key == "header")
+		{
+			auto colon = value.find(": ");
+			if (colon != std::string::npos)
+				entry.headers[value.substr(0, colon)] = value.substr(colon + 2);
+		}
+	}
+
+	if (entry.url.empty() || pathFor(entry.url) + ".meta" != path)
+		return false;
+
+	// approximate the last access time by when the meta file was last touched
+	// (the filesystem clock has its own epoch, so go by how long ago that was)
+	std::error_code ec;
+	auto modified = std::filesystem::last_write_time(path, ec);
+	entry.lastAccess = entry.storedAt;
+	if (!ec)
+	{
+		auto ago = std::filesystem::file_time_type::clock::now() - modified;
+		entry.lastAccess = time(NULL) - std::chrono::duration_cast<std::chrono::seconds>(ago).count();
+	}
+
+	updateFreshness(entry, entry.storedAt);
+	return true;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct NetRequest;
+
+// ~32MB on disk is plenty for HTML, and small enough for console SD cards
+#define HTTP_CACHE_DISK_LIMIT 0x2000000
+// private browsing keeps its cache in RAM only
+#define HTTP_CACHE_MEMORY_LIMIT 0x800000
+
+struct HttpCacheEntry
+{
+	std::string url;
+	int status = 200;
+	std::map<std::string, std::string> headers;
+
+	time_t storedAt = 0;			// when the response was last (re)validated
+	time_t lifetime = 0;			// seconds the response stays fresh
+	time_t staleWhileRevalidate = 0; // seconds it can be served stale after that
+	bool noCache = false;			 // must be revalidated before every use
+
+	size_t size = 0; // bytes actually stored, after compression
+	time_t lastAccess = 0;
+
+	// text bodies are kept deflated, and inflated again when served
+	bool deflated = false;
+	size_t decodedSize = 0;
+
+	std::string body; // only kept in memory for the in-memory partition
+
+	bool isFresh(time_t now) const;
+	bool isUsableStale(time_t now) const;
+};
+
+// An HTTP cache keyed by URL that honors Cache-Control/Expires and revalidates
+// with If-None-Match/If-Modified-Since. There are two partitions: one stored
+// under ./data/cache and an in-memory one for private browsing. The index lives
+// on the main thread, the files are only read and written on the network
+// worker, in the order the main thread asked for it.
+class HttpCache
+{
+public:
+	static HttpCache& getInstance(bool isPrivate = false);
+
+	// fetch through the cache, onComplete runs on the main thread (from a cache
+	// hit or from the network). Pass revalidate to skip fresh hits (reloads).
+	// If onData is set, a network response is streamed to it as it arrives.
+	// Identical fetches made while one is already on the network (eg. by two
+	// tabs on the same site) share its transfer, every caller still gets a
+	// request of its own.
+	std::shared_ptr<NetRequest> fetch(const std::string& url, bool revalidate,
+		std::function<void(NetRequest&)> onComplete,
+		std::function<void(NetRequest&)> onData = nullptr);
+
+	// give up on a fetch, its transfer is only aborted once no other caller is
+	// waiting on it anymore
+	void cancel(const std::shared_ptr<NetRequest>& request);
+
+	// identifies the response stored for url (its ETag or Last-Modified), if
+	// it's still fresh enough to use without a request, otherwise empty
+	std::string validator(const std::string& url);
+
+	void clear();
+
+	// counters for debugging
+	int hits = 0;
+	int staleHits = 0;
+	int revalidations = 0; // 304s
+	int misses = 0;
+	int coalesced = 0; // fetches that joined a transfer already in flight
+	size_t storedBytes = 0;	 // bodies as written to the cache
+	size_t decodedBytes = 0; // the same bodies before compression
+
+private:
+	HttpCache(const std::string& directory, size_t maxBytes);
+
+	const std::string directory; // empty for the in-memory partition
+	size_t maxBytes;
+	size_t totalBytes = 0;
+	bool loading = false; // the index is being read in on the worker
+	bool loaded = false;
+
+	std::map<std::string, HttpCacheEntry> entries;
+
+	// fetches made before the index was loaded, resolved once it is
+	struct Deferred
+	{
+		std::shared_ptr<NetRequest> request;
+		bool revalidate;
+		std::function<void(NetRequest&)> onComplete;
+		std::function<void(NetRequest&)> onData;
+	};
+	std::vector<Deferred> deferred;
+
+	// responses still being written out, by url, and which store each was
+	std::map<std::string, uint64_t> storing;
+	uint64_t storeGeneration = 0;
+
+	// transfers on the network by url, and the callers waiting on each
+	struct Waiter
+	{
+		std::shared_ptr<NetRequest> request;
+		std::function<void(NetRequest&)> onComplete;
+		std::function<void(NetRequest&)> onData;
+	};
+	struct InFlight
+	{
+		std::shared_ptr<NetRequest> transfer;
+		std::vector<Waiter> waiters;
+	};
+	std::map<std::string, InFlight> inFlight;
+	void streamToWaiters(NetRequest& transfer);
+	void completeWaiters(NetRequest& transfer);
+
+	void ensureLoaded();
+	HttpCacheEntry* lookup(const std::string& url);
+	void resolve(const std::shared_ptr<NetRequest>& waiter, bool revalidate,
+		std::function<void(NetRequest&)> onComplete,
+		std::function<void(NetRequest&)> onData);
+	void fetchFromNetwork(const std::shared_ptr<NetRequest>& waiter,
+		const HttpCacheEntry* entry, std::function<void(NetRequest&)> onComplete,
+		std::function<void(NetRequest&)> onData);
+	void store(NetRequest& response);
+	std::shared_ptr<NetRequest> startTransfer(const std::string& url,
+		const HttpCacheEntry* entry, bool streaming);
+	void refetch(NetRequest& transfer);
+
+	// false if the callers can't be completed with this response (and it was
+	// asked for again)
+	bool handleResponse(NetRequest& response);
+	void revalidateInBackground(const HttpCacheEntry& entry);
+	void addConditionalHeaders(NetRequest& request, const HttpCacheEntry& entry);
+	static void updateFreshness(HttpCacheEntry& entry, time_t now);
+
+	// reads (and inflates) a stored body on the worker thread, into the
+	// request's body, setting success if it's intact
+	std::function<void(NetRequest&)> readWork(const HttpCacheEntry& entry);
+	void serveStored(const std::shared_ptr<NetRequest>& waiter,
+		HttpCacheEntry& entry, std::function<void(NetRequest&)> onComplete,
+		std::function<void(NetRequest&)> onData);
+
+	void remove(const std::string& url);
+	void removeFiles(const std::string& url);
+	void evictToFit(size_t incoming);
+
+	// (these only look at directory, so they're safe on the worker too)
+	std::string pathFor(const std::string& url) const;
+	bool readEntryMeta(const std::string& path, HttpCacheEntry& entry) const;
+	static std::string formatEntryMeta(const HttpCacheEntry& entry);
+	void writeEntryMeta(const HttpCacheEntry& entry);
+	void touch(HttpCacheEntry& entry);
+};
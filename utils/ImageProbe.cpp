@@ -0,0 +1,154 @@
+#include "ImageProbe.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+static uint32_t readBigEndian(const unsigned char* p, int bytes)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < bytes; i++)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+static uint32_t readLittleEndian(const unsigned char* p, int bytes)
+{
+	uint32_t value = 0;
+	for (int i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+static ImageProbeResult probePng(const unsigned char* p, size_t size,
+	int& width, int& height)
+{
+	// signature, then the IHDR chunk is always first
+	if (size < 24)
+		return PROBE_NEED_MORE;
+	if (memcmp(p + 12, "IHDR", 4) != 0)
+		return PROBE_UNKNOWN;
+
+	width = readBigEndian(p + 16, 4);
+	height = readBigEndian(p + 20, 4);
+	return PROBE_FOUND;
+}
+
+static ImageProbeResult probeGif(const unsigned char* p, size_t size,
+	int& width, int& height)
+{
+	// logical screen descriptor follows the 6 byte signature
+	if (size < 10)
+		return PROBE_NEED_MORE;
+
+	width = readLittleEndian(p + 6, 2);
+	height = readLittleEndian(p + 8, 2);
+	return PROBE_FOUND;
+}
+
+static ImageProbeResult probeWebp(const unsigned char* p, size_t size,
+	int& width, int& height)
+{
+	if (size < 30)
+		return PROBE_NEED_MORE;
+
+	if (memcmp(p + 12, "VP8 ", 4) == 0)
+	{
+		// lossy: key frame start code, then 14 bit dimensions
+		if (p[23] != 0x9d || p[24] != 0x01 || p[25] != 0x2a)
+			return PROBE_UNKNOWN;
+		width = readLittleEndian(p + 26, 2) & 0x3fff;
+		height = readLittleEndian(p + 28, 2) & 0x3fff;
+		return PROBE_FOUND;
+	}
+
+	if (memcmp(p + 12, "VP8L", 4) == 0)
+	{
+		// lossless: signature byte, then width-1 and height-1 in 14 bits each
+		if (p[20] != 0x2f)
+			return PROBE_UNKNOWN;
+		uint32_t bits = readLittleEndian(p + 21, 4);
+		width = (bits & 0x3fff) + 1;
+		height = ((bits >> 14) & 0x3fff) + 1;
+		return PROBE_FOUND;
+	}
+
+	if (memcmp(p + 12, "VP8X", 4) == 0)
+	{
+		// extended: 24 bit canvas width-1 and height-1
+		width = readLittleEndian(p + 24, 3) + 1;
+		height = readLittleEndian(p + 27, 3) + 1;
+		return PROBE_FOUND;
+	}
+
+	return PROBE_UNKNOWN;
+}
+
+static ImageProbeResult probeJpeg(const unsigned char* p, size_t size,
+	int& width, int& height)
+{
+	// walk the segments until a start-of-frame marker turns up
+	size_t pos = 2;
+	while (true)
+	{
+		if (pos + 4 > size)
+			return PROBE_NEED_MORE;
+		if (p[pos] != 0xff)
+			return PROBE_UNKNOWN;
+
+		unsigned char marker = p[pos + 1];
+		if (marker == 0xff)
+		{
+			// fill byte
+			pos++;
+			continue;
+		}
+
+		// standalone markers have no length
+		if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+		{
+			pos += 2;
+			continue;
+		}
+
+		// SOF0-SOF15, except DHT (c4), JPG (c8) and DAC (cc)
+		if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+		{
+			if (pos + 9 > size)
+				return PROBE_NEED_MORE;
+			height = readBigEndian(p + pos + 5, 2);
+			width = readBigEndian(p + pos + 7, 2);
+			return PROBE_FOUND;
+		}
+
+		// start of scan or end of image before any frame header
+		if (marker == 0xda || marker == 0xd9)
+			return PROBE_UNKNOWN;
+
+		pos += 2 + readBigEndian(p + pos + 2, 2);
+	}
+}
+
+ImageProbeResult probeImageSize(const std::string& data, int& width, int& height)
+{
+	auto p = (const unsigned char*)data.data();
+	size_t size = data.size();
+
+	if (size < 12)
+		return PROBE_NEED_MORE;
+
+	ImageProbeResult result = PROBE_UNKNOWN;
+	if (memcmp(p, "\x89PNG\r\n\x1a\n", 8) == 0)
+		result = probePng(p, size, width, height);
+	else if (memcmp(p, "GIF87a", 6) == 0 || memcmp(p, "GIF89a", 6) == 0)
+		result = probeGif(p, size, width, height);
+	else if (memcmp(p, "RIFF", 4) == 0 && memcmp(p + 8, "WEBP", 4) == 0)
+		result = probeWebp(p, size, width, height);
+	else if (p[0] == 0xff && p[1] == 0xd8)
+		result = probeJpeg(p, size, width, height);
+
+	if (result == PROBE_FOUND && (width <= 0 || height <= 0))
+		return PROBE_UNKNOWN;
+	if (result == PROBE_NEED_MORE && size >= IMAGE_PROBE_MAX_BYTES)
+		return PROBE_UNKNOWN;
+	return result;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+// give up on finding the size if it's not in this many bytes (JPEGs can carry a
+// lot of EXIF data before the frame header)
+#define IMAGE_PROBE_MAX_BYTES 0x10000
+
+enum ImageProbeResult
+{
+	PROBE_FOUND,
+	PROBE_NEED_MORE, // looks like a known format, but the header isn't all here yet
+	PROBE_UNKNOWN,	 // not a format we can read the size of
+};
+
+// Reads the pixel dimensions out of the start of a PNG, JPEG, GIF or WebP file,
+// so layout can reserve the right space before the image is downloaded and
+// decoded. Safe to call repeatedly as more of the data streams in.
+ImageProbeResult probeImageSize(const std::string& data, int& width, int& height);
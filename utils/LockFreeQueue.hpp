@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// An unbounded multi-producer, single-consumer queue that never takes a lock.
+// Producers can push from any thread, but only one thread may pop (usually the
+// main loop). Based on Dmitry Vyukov's node-based MPSC queue.
+template <typename T>
+class LockFreeQueue
+{
+public:
+	LockFreeQueue()
+	{
+		// the queue always holds a stub node, so head and tail are never null
+		head = new Node();
+		tail.store(head, std::memory_order_relaxed);
+	}
+
+	~LockFreeQueue()
+	{
+		while (head != nullptr)
+		{
+			Node* next = head->next.load(std::memory_order_relaxed);
+			delete head;
+			head = next;
+		}
+	}
+
+	LockFreeQueue(const LockFreeQueue&) = delete;
+	LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+	// safe to call from any thread
+	void push(T value)
+	{
+		Node* node = new Node();
+		node->value = std::move(value);
+		Node* prev = tail.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	// consumer thread only, returns false if nothing is (fully) queued yet
+	bool pop(T& out)
+	{
+		Node* next = head->next.load(std::memory_order_acquire);
+		if (next == nullptr)
+			return false;
+
+		out = std::move(next->value);
+		next->value = T();
+
+		// the popped node becomes the new stub
+		delete head;
+		head = next;
+		return true;
+	}
+
+	// consumer thread only
+	bool empty() const
+	{
+		return head->next.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+	struct Node
+	{
+		T value {};
+		std::atomic<Node*> next { nullptr };
+	};
+
+	Node* head; // only touched by the consumer
+	std::atomic<Node*> tail;
+};
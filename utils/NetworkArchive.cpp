@@ -0,0 +1,176 @@
+#include "NetworkArchive.hpp"
+#include "NetworkWorker.hpp"
+#include "Utils.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+NetworkArchive& NetworkArchive::getInstance()
+{
+	static NetworkArchive instance;
+	return instance;
+}
+
+NetworkArchive::~NetworkArchive()
+{
+	if (file != nullptr)
+		fclose(file);
+}
+
+bool NetworkArchive::profile(const std::string& name, NetworkShaping& shaping)
+{
+	// rough figures for each console on a typical home wifi network
+	if (name == "3ds")
+		shaping = { 120, 0x20000, 0.02f };
+	else if (name == "wiiu")
+		shaping = { 60, 0x100000, 0.01f };
+	else if (name == "switch")
+		shaping = { 40, 0x400000, 0.005f };
+	else
+		return false;
+	return true;
+}
+
+bool NetworkArchive::startRecording(const std::string& path)
+{
+	file = fopen(path.c_str(), "ab");
+	if (file == nullptr)
+	{
+		std::cout << "[NetworkArchive] Can't record to " << path << std::endl;
+		return false;
+	}
+	std::cout << "[NetworkArchive] Recording responses to " << path << std::endl;
+	return true;
+}
+
+bool NetworkArchive::startReplaying(const std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		std::cout << "[NetworkArchive] Can't replay " << path << std::endl;
+		return false;
+	}
+
+	// see record() for the layout
+	std::string key, line;
+	int count = 0;
+	while (std::getline(in, key) && std::getline(in, line))
+	{
+		ArchivedResponse response;
+		size_t headerCount = 0, bodySize = 0;
+		std::istringstream stats(line);
+		stats >> response.status >> response.wireSize >> response.firstByteMs
+			>> response.totalMs >> headerCount >> bodySize;
+
+		for (size_t x = 0; x < headerCount && std::getline(in, line); x++)
+		{
+			auto colon = line.find(": ");
+			if (colon != std::string::npos)
+				response.headers[line.substr(0, colon)] = line.substr(colon + 2);
+		}
+
+		response.body.resize(bodySize);
+		if (!in.read(&response.body[0], bodySize))
+			break;
+		in.ignore(1); // the newline after the body
+
+		entries[key].responses.push_back(std::move(response));
+		count++;
+	}
+
+	isReplaying = true;
+	std::cout << "[NetworkArchive] Replaying " << count << " response" << plural(count)
+			  << " for " << entries.size() << " request" << plural(entries.size())
+			  << " from " << path << std::endl;
+	return true;
+}
+
+std::string NetworkArchive::keyFor(const NetRequest& request, bool conditional)
+{
+	std::string key = (request.headOnly ? "HEAD " : "GET ") + request.url;
+
+	// ranges are different responses, and a revalidation can be answered with
+	// a 304 that a plain request can't
+	for (auto& header : request.requestHeaders)
+	{
+		if (header.find("Range:") == 0)
+			key += " " + header;
+	}
+	if (conditional)
+		key += " (conditional)";
+	return key;
+}
+
+static bool isConditional(const NetRequest& request)
+{
+	for (auto& header : request.requestHeaders)
+	{
+		if (header.find("If-None-Match:") == 0 || header.find("If-Modified-Since:") == 0)
+			return true;
+	}
+	return false;
+}
+
+void NetworkArchive::record(const NetRequest& request)
+{
+	if (file == nullptr || request.resolveOnly || request.outFd >= 0)
+		return;
+
+	// (a big body went to disk on its way in)
+	std::string spilledBody;
+	if (request.spilled != nullptr)
+		spilledBody = readFile(request.spilled->path);
+	const std::string& body = request.spilled != nullptr ? spilledBody : request.body;
+
+	// the key, "status wire first-byte-ms total-ms header-count body-size",
+	// the headers one per line, then the body and a newline
+	std::ostringstream out;
+	out << keyFor(request, isConditional(request)) << "\n"
+		<< request.httpCode << " " << request.bytesOnWire.load() << " "
+		<< request.firstByteMs << " " << request.totalMs << " "
+		<< request.headers.size() << " " << body.size() << "\n";
+	for (auto& [name, value] : request.headers)
+		out << name << ": " << value << "\n";
+
+	auto record = out.str();
+	fwrite(record.data(), 1, record.size(), file);
+	fwrite(body.data(), 1, body.size(), file);
+	fputc('\n', file);
+	fflush(file);
+	recorded++;
+}
+
+const ArchivedResponse* NetworkArchive::lookup(const NetRequest& request)
+{
+	bool conditional = isConditional(request);
+	auto it = entries.find(keyFor(request, conditional));
+
+	// a full response still answers a revalidation
+	if (it == entries.end() && conditional)
+		it = entries.find(keyFor(request, false));
+
+	if (it == entries.end())
+	{
+		std::cout << "[NetworkArchive] Not recorded: " << request.url << std::endl;
+		missing++;
+		return nullptr;
+	}
+
+	auto& recorded = it->second;
+	auto& response = recorded.responses[recorded.next];
+	if (recorded.next + 1 < recorded.responses.size())
+		recorded.next++;
+	replayed++;
+	return &response;
+}
+
+void NetworkArchive::logStats()
+{
+	if (file == nullptr && !isReplaying)
+		return;
+
+	std::cout << "[NetworkArchive] " << recorded << " recorded, " << replayed
+			  << " replayed, " << missing << " missing" << std::endl;
+}
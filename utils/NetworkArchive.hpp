@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+struct NetRequest;
+
+// replayed bodies arrive in pieces this big (of the decoded body), each of
+// which can be "lost" and take a resend timeout longer
+#define ARCHIVE_SEGMENT_SIZE 0x4000
+#define ARCHIVE_RESEND_MS 300
+
+// A response as it was recorded
+struct ArchivedResponse
+{
+	int status = 0;
+	std::map<std::string, std::string> headers;
+	std::string body;	 // decoded, as the page got it
+	size_t wireSize = 0; // what it took on the network (before decoding)
+	int firstByteMs = 0; // from sending the request to the first byte back
+	int totalMs = 0;
+};
+
+// The network to pretend to be on while replaying, -1 to keep the timing that
+// was recorded
+struct NetworkShaping
+{
+	int latencyMs = -1; // round trip before a response starts
+	int bandwidth = -1; // bytes per second on the wire
+	float loss = 0;		// chance (0 - 1) that a segment has to be resent
+};
+
+// Records every response of a browsing session (headers, body and timing) into
+// an archive file, and replays them later in place of the network, so that page
+// loads can be benchmarked offline and the same way every time, under the
+// conditions of the console being emulated.
+class NetworkArchive
+{
+public:
+	static NetworkArchive& getInstance();
+
+	// append every response from the network to path, from now on
+	bool startRecording(const std::string& path);
+
+	// serve requests from path instead of the network (before networking starts)
+	bool startReplaying(const std::string& path);
+
+	bool recording() const { return file != nullptr; }
+	bool replaying() const { return isReplaying; }
+
+	// typical conditions by console ("3ds", "wiiu" or "switch")
+	static bool profile(const std::string& name, NetworkShaping& shaping);
+	NetworkShaping shaping;
+
+	// main thread: capture a request that just completed
+	void record(const NetRequest& request);
+
+	// worker thread: what to answer request with, nullptr if it wasn't recorded.
+	// A url recorded more than once gets its responses in order (the last one
+	// repeats from then on).
+	const ArchivedResponse* lookup(const NetRequest& request);
+
+	// counters for debugging
+	int recorded = 0;
+	std::atomic<int> replayed { 0 };
+	std::atomic<int> missing { 0 };
+	void logStats();
+
+private:
+	NetworkArchive() = default;
+	~NetworkArchive();
+
+	FILE* file = nullptr; // while recording
+	bool isReplaying = false;
+
+	struct Recorded
+	{
+		std::vector<ArchivedResponse> responses;
+		size_t next = 0; // worker thread only
+	};
+	std::map<std::string, Recorded> entries; // by key, read only once replaying
+
+	static std::string keyFor(const NetRequest& request, bool conditional);
+};
@@ -0,0 +1,558 @@
+#include "NetworkWorker.hpp"
+#include "ConnectionPool.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+
+float NetRequest::progress() const
+{
+	if (transfer != nullptr)
+		return transfer->progress();
+
+	// Content-Length counts the (possibly compressed) bytes on the wire
+	size_t total = bytesTotal.load();
+	if (total > 0)
+		return std::min(1.0f, (float)bytesOnWire.load() / total);
+
+	size_t received = bytesReceived.load();
+
+	// unknown size, creep towards the end as bytes keep arriving
+	return (float)received / (received + 0x40000);
+}
+
+std::shared_ptr<SpilledBody> SpilledBody::create(const std::string& prefix)
+{
+	static std::atomic<int> counter { 0 };
+
+	auto spilled = std::make_shared<SpilledBody>();
+	spilled->path = std::string(NETWORK_SPILL_DIRECTORY "/")
+		+ std::to_string(counter++) + ".part";
+	spilled->file = fopen(spilled->path.c_str(), "wb");
+	if (spilled->file == nullptr || !spilled->append(prefix.data(), prefix.size()))
+		return nullptr;
+	return spilled;
+}
+
+bool SpilledBody::append(const char* data, size_t length)
+{
+	if (file == nullptr || fwrite(data, 1, length, file) != length)
+		return false;
+	size += length;
+	return true;
+}
+
+void SpilledBody::close()
+{
+	if (file != nullptr)
+		fclose(file);
+	file = nullptr;
+}
+
+SpilledBody::~SpilledBody()
+{
+	close();
+	std::remove(path.c_str());
+}
+
+void NetRequest::appendBody(std::string& buffer, const char* data, size_t length)
+{
+	if (spilled == nullptr && memoryLimit > 0 && buffer.size() + length > memoryLimit)
+	{
+		spilled = SpilledBody::create(buffer);
+		if (spilled != nullptr)
+		{
+			std::cout << "[NetworkWorker] Spilling " << url << " to " << spilled->path
+					  << std::endl;
+			std::string().swap(buffer);
+		}
+		else
+			memoryLimit = 0; // couldn't write the file, keep going in memory
+	}
+
+	if (spilled != nullptr)
+		spilled->append(data, length);
+	else
+		buffer.append(data, length);
+}
+
+// done with a download's file, see NetRequest::outFd
+static void closeOutput(NetRequest& request)
+{
+	if (request.outFd >= 0)
+		close(request.outFd);
+	request.outFd = -1;
+}
+
+NetworkWorker& NetworkWorker::getInstance()
+{
+	static NetworkWorker instance;
+	return instance;
+}
+
+NetworkWorker::~NetworkWorker()
+{
+	stop();
+}
+
+void NetworkWorker::start()
+{
+#ifndef NETWORK_MOCK
+	if (running)
+		return;
+
+	multi = curl_multi_init();
+	ConnectionPool::getInstance().configureMulti(multi);
+	running = true;
+	thread = std::thread(&NetworkWorker::run, this);
+#endif
+}
+
+void NetworkWorker::stop()
+{
+#ifndef NETWORK_MOCK
+	if (!running)
+		return;
+
+	running = false;
+	curl_multi_wakeup(multi);
+	if (thread.joinable())
+		thread.join();
+
+	// abandon anything that was still in flight
+	for (auto& [handle, transfer] : active)
+	{
+		curl_multi_remove_handle(multi, handle);
+		curl_easy_cleanup(handle);
+		curl_slist_free_all(transfer.headers);
+		closeOutput(*transfer.request);
+	}
+	active.clear();
+	replays.clear();
+
+	curl_multi_cleanup(multi);
+	multi = nullptr;
+#endif
+}
+
+std::shared_ptr<NetRequest> NetworkWorker::fetch(const std::string& url,
+	std::function<void(NetRequest&)> onComplete)
+{
+	auto request = std::make_shared<NetRequest>();
+	request->url = url;
+	request->onComplete = onComplete;
+	submit(request);
+	return request;
+}
+
+void NetworkWorker::submit(const std::shared_ptr<NetRequest>& request)
+{
+	pendingCount++;
+	if (request->streaming)
+		streamingRequests.push_back(request);
+
+#ifndef NETWORK_MOCK
+	incoming.push(request);
+	curl_multi_wakeup(multi);
+#else
+	// no network, complete right away (on the next drain)
+	closeOutput(*request);
+	request->success = true;
+	if (request->work)
+		request->work(*request);
+	request->done = true;
+	completed.push(request);
+#endif
+}
+
+void NetworkWorker::deliver(const std::shared_ptr<NetRequest>& request)
+{
+	pendingCount++;
+	request->done = true;
+	completed.push(request);
+}
+
+std::shared_ptr<NetRequest> NetworkWorker::runOnWorker(
+	std::function<void(NetRequest&)> work,
+	std::function<void(NetRequest&)> onComplete)
+{
+	auto request = std::make_shared<NetRequest>();
+	request->work = work;
+	request->onComplete = onComplete;
+	submit(request);
+	return request;
+}
+
+void NetworkWorker::cancel(const std::shared_ptr<NetRequest>& request)
+{
+	if (request == nullptr)
+		return;
+
+	// the worker notices this in its progress callback and aborts the transfer
+	request->cancelled = true;
+#ifndef NETWORK_MOCK
+	curl_multi_wakeup(multi);
+#endif
+}
+
+// the chunks of a streamed request are already on the main thread by the time
+// they're appended, so if its body spills to disk, the writes happen here too
+// (only ever for pages past NETWORK_MEMORY_LIMIT, appended through stdio's
+// buffer)
+bool NetworkWorker::pumpChunks(NetRequest& request)
+{
+	bool gotData = false;
+	std::string chunk;
+	while (request.chunks.pop(chunk))
+	{
+		request.appendBody(request.received, chunk.data(), chunk.size());
+		gotData = true;
+	}
+	return gotData;
+}
+
+int NetworkWorker::drain()
+{
+	int count = 0;
+
+	// hand over whatever has streamed in so far
+	for (auto& streamed : streamingRequests)
+	{
+		if (pumpChunks(*streamed) && !streamed->cancelled && streamed->onData)
+		{
+			streamed->onData(*streamed);
+			count++;
+		}
+	}
+
+	std::shared_ptr<NetRequest> request;
+	while (completed.pop(request))
+	{
+		pendingCount--;
+		if (request->streaming)
+		{
+			// all chunks were queued before the completion, so this gets the rest
+			pumpChunks(*request);
+			request->body = std::move(request->received);
+			if (request->spilled != nullptr)
+				request->spilled->close();
+			request->onData = nullptr;
+			streamingRequests.erase(std::remove(streamingRequests.begin(),
+										streamingRequests.end(), request),
+				streamingRequests.end());
+		}
+
+		// (before onComplete, which is free to take the body)
+		if (!request->cancelled && !request->fromCache && !request->work)
+			NetworkArchive::getInstance().record(*request);
+
+		if (!request->cancelled && request->onComplete)
+		{
+			request->onComplete(*request);
+			count++;
+		}
+		// drop the callbacks so that anything they captured is released now
+		request->onComplete = nullptr;
+		request->work = nullptr;
+	}
+	return count;
+}
+
+#ifndef NETWORK_MOCK
+// worker thread: take in part of a response body, from curl or a replay
+static void receiveBody(NetRequest* request, const char* data, size_t length)
+{
+	if (request->streaming)
+	{
+		// the headers are all in before the first byte of the body, and the
+		// chunk queue hands them over to the main thread along with it
+		request->headersReady = true;
+		request->chunks.push(std::string(data, length));
+	}
+	else
+		request->appendBody(request->body, data, length);
+	request->bytesReceived += length;
+}
+
+static size_t WorkerWriteCallback(void* contents, size_t size, size_t nmemb,
+	void* userp)
+{
+	size_t realsize = size * nmemb;
+	receiveBody((NetRequest*)userp, (const char*)contents, realsize);
+	return realsize;
+}
+
+static size_t WorkerFileWriteCallback(void* contents, size_t size, size_t nmemb,
+	void* userp)
+{
+	CURL* handle = (CURL*)userp;
+	NetRequest* request = nullptr;
+	curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**)&request);
+
+	// don't write an error page (or the whole file, if the server ignored the
+	// range) into the middle of the file. Downloads only ever send Range and
+	// If-Range headers, so any at all means a range was asked for.
+	long httpCode = 0;
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &httpCode);
+	if (httpCode != 206 && (httpCode != 200 || !request->requestHeaders.empty()))
+		return 0;
+
+	// positional writes, so several ranges of one file can come in at once
+	size_t realsize = size * nmemb;
+	const char* data = (const char*)contents;
+	for (size_t written = 0; written < realsize;)
+	{
+		ssize_t result = pwrite(request->outFd, data + written, realsize - written,
+			(off_t)request->outOffset);
+		if (result <= 0)
+			return 0; // aborts the transfer
+		written += result;
+		request->outOffset += result;
+	}
+	request->bytesReceived += realsize;
+	return realsize;
+}
+
+static int WorkerProgressCallback(void* clientp, curl_off_t dltotal,
+	curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+	NetRequest* request = (NetRequest*)clientp;
+	if (dltotal > 0)
+		request->bytesTotal = (size_t)dltotal;
+	request->bytesOnWire = (size_t)dlnow;
+
+	// returning non-zero aborts the transfer
+	return request->cancelled ? 1 : 0;
+}
+
+// by the time curl wants a socket the lookup has been cached, so stop there
+static curl_socket_t RefuseSocketCallback(void* clientp, curlsocktype purpose,
+	struct curl_sockaddr* address)
+{
+	return CURL_SOCKET_BAD;
+}
+
+void NetworkWorker::startTransfer(const std::shared_ptr<NetRequest>& request)
+{
+	if (request->cancelled)
+	{
+		closeOutput(*request);
+		completed.push(request);
+		return;
+	}
+
+	if (request->work)
+	{
+		request->work(*request);
+		request->done = true;
+		completed.push(request);
+		return;
+	}
+
+	if (NetworkArchive::getInstance().replaying())
+	{
+		startReplay(request);
+		return;
+	}
+
+	CURL* handle = curl_easy_init();
+	if (handle == nullptr)
+	{
+		closeOutput(*request);
+		request->done = true;
+		completed.push(request);
+		return;
+	}
+
+	setPlatformCurlFlags(handle);
+	ConnectionPool::getInstance().attach(handle, request->isPrivate);
+
+	curl_easy_setopt(handle, CURLOPT_URL, request->url.c_str());
+	curl_easy_setopt(handle, CURLOPT_USERAGENT, USER_AGENT);
+	curl_easy_setopt(handle, CURLOPT_PRIVATE, request.get());
+
+	if (request->outFd >= 0)
+	{
+		curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WorkerFileWriteCallback);
+		curl_easy_setopt(handle, CURLOPT_WRITEDATA, handle);
+	}
+	else
+	{
+		curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, ACCEPT_ENCODING);
+		curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WorkerWriteCallback);
+		curl_easy_setopt(handle, CURLOPT_WRITEDATA, request.get());
+	}
+	curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
+	curl_easy_setopt(handle, CURLOPT_HEADERDATA, &request->headers);
+
+	curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, WorkerProgressCallback);
+	curl_easy_setopt(handle, CURLOPT_XFERINFODATA, request.get());
+	curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+
+	if (request->resolveOnly)
+		curl_easy_setopt(handle, CURLOPT_OPENSOCKETFUNCTION, RefuseSocketCallback);
+	if (request->headOnly)
+		curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+
+	curl_slist* headers = NULL;
+	for (auto& header : request->requestHeaders)
+		headers = curl_slist_append(headers, header.c_str());
+	if (headers != NULL)
+		curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+
+	active[handle] = { request, headers };
+	curl_multi_add_handle(multi, handle);
+}
+
+void NetworkWorker::finishTransfer(CURL* handle, CURLcode result)
+{
+	auto it = active.find(handle);
+	if (it == active.end())
+		return;
+
+	auto request = it->second.request;
+	curl_slist_free_all(it->second.headers);
+	active.erase(it);
+
+	long httpCode = 0;
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &httpCode);
+	request->httpCode = (int)httpCode;
+	request->success = result == CURLE_OK;
+
+	// the body size before content decoding, ie. what actually came over the wire
+	curl_off_t wireSize = 0;
+	if (curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &wireSize) == CURLE_OK)
+		request->bytesOnWire = (size_t)wireSize;
+
+	curl_off_t firstByte = 0, total = 0;
+	curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+	request->firstByteMs = (int)(firstByte / 1000);
+	request->totalMs = (int)(total / 1000);
+	ConnectionPool::getInstance().recordTransfer(handle);
+
+	// a streamed body is still being written out on the main thread, which
+	// owns spilled for those, so don't even look at it here
+	if (!request->streaming && request->spilled != nullptr)
+		request->spilled->close();
+
+	curl_multi_remove_handle(multi, handle);
+	curl_easy_cleanup(handle);
+	closeOutput(*request);
+
+	// hand it back to the main thread, all writes above happen-before the pop
+	request->done = true;
+	completed.push(request);
+}
+
+void NetworkWorker::startReplay(const std::shared_ptr<NetRequest>& request)
+{
+	auto& archive = NetworkArchive::getInstance();
+	const ArchivedResponse* response = request->resolveOnly ? nullptr : archive.lookup(*request);
+	if (response == nullptr)
+	{
+		// not recorded is the same as being offline (and nothing to resolve)
+		request->success = request->resolveOnly;
+		closeOutput(*request);
+		request->done = true;
+		completed.push(request);
+		return;
+	}
+
+	auto& shaping = archive.shaping;
+	int latency = shaping.latencyMs >= 0 ? shaping.latencyMs : response->firstByteMs;
+
+	// as long as it took when recorded, unless there's a bandwidth to emulate
+	double transferMs = response->totalMs - response->firstByteMs;
+	if (shaping.bandwidth > 0)
+		transferMs = response->wireSize * 1000.0 / shaping.bandwidth;
+
+	Replay replay;
+	replay.request = request;
+	replay.response = response;
+	replay.nextAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(latency);
+	replay.msPerByte = response->body.empty() ? 0 : transferMs / response->body.size();
+
+	request->headers = response->headers;
+	if (response->headers.count("content-length"))
+		request->bytesTotal = response->wireSize;
+	replays.push_back(replay);
+}
+
+int NetworkWorker::advanceReplays()
+{
+	auto& shaping = NetworkArchive::getInstance().shaping;
+	auto now = std::chrono::steady_clock::now();
+	int wait = 100;
+
+	for (auto it = replays.begin(); it != replays.end();)
+	{
+		auto& replay = *it;
+		auto& request = replay.request;
+		auto& body = replay.response->body;
+
+		// a segment at a time, for as many as are due
+		while (!request->cancelled && replay.sent < body.size() && replay.nextAt <= now)
+		{
+			size_t length = std::min((size_t)ARCHIVE_SEGMENT_SIZE, body.size() - replay.sent);
+			receiveBody(request.get(), body.data() + replay.sent, length);
+			replay.sent += length;
+			request->bytesOnWire = replay.response->wireSize * replay.sent / body.size();
+
+			double ms = length * replay.msPerByte;
+			if (shaping.loss > 0 && rand() < shaping.loss * RAND_MAX)
+				ms += std::max(ARCHIVE_RESEND_MS, 2 * std::max(shaping.latencyMs, 0));
+			replay.nextAt += std::chrono::microseconds((long long)(ms * 1000));
+		}
+
+		bool finished = replay.sent >= body.size() && replay.nextAt <= now;
+		if (!request->cancelled && !finished)
+		{
+			auto due = std::chrono::duration_cast<std::chrono::milliseconds>(replay.nextAt - now);
+			wait = std::min(wait, std::max(1, (int)due.count()));
+			++it;
+			continue;
+		}
+
+		// (cancelled ones end the same way as an aborted curl transfer)
+		request->httpCode = replay.response->status;
+		request->success = !request->cancelled;
+		request->bytesOnWire = replay.response->wireSize;
+		closeOutput(*request);
+		request->done = true;
+		completed.push(request);
+		it = replays.erase(it);
+	}
+	return wait;
+}
+
+void NetworkWorker::run()
+{
+	std::shared_ptr<NetRequest> request;
+	while (running)
+	{
+		// pick up any newly submitted requests
+		while (incoming.pop(request))
+			startTransfer(request);
+
+		int stillRunning = 0;
+		curl_multi_perform(multi, &stillRunning);
+
+		// collect finished transfers (including ones aborted by cancellation)
+		int msgsLeft = 0;
+		CURLMsg* msg;
+		while ((msg = curl_multi_info_read(multi, &msgsLeft)) != nullptr)
+		{
+			if (msg->msg == CURLMSG_DONE)
+				finishTransfer(msg->easy_handle, msg->data.result);
+		}
+
+		// sleep until there's socket activity, a wakeup, or the timeout (or
+		// the next replayed segment is due)
+		int timeout = advanceReplays();
+		curl_multi_poll(multi, NULL, 0, timeout, NULL);
+	}
+}
+#endif
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "LockFreeQueue.hpp"
+#include "NetworkArchive.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef NETWORK_MOCK
+#include <curl/curl.h>
+#endif
+
+// response bodies bigger than this are written to a temp file as they arrive,
+// instead of being held in memory
+#define NETWORK_MEMORY_LIMIT 0x800000
+#define NETWORK_SPILL_DIRECTORY "./data/tmp"
+
+// A response body that went to disk, the file is deleted along with the last
+// request that refers to it
+struct SpilledBody
+{
+	~SpilledBody();
+
+	std::string path;
+	size_t size = 0;
+	FILE* file = nullptr; // open until the transfer finishes
+
+	static std::shared_ptr<SpilledBody> create(const std::string& prefix);
+	bool append(const char* data, size_t length);
+	void close();
+};
+
+// A single request handed to the network worker. The worker thread fills in the
+// response fields, and they are only safe to read once onComplete is invoked on
+// the main thread (or after done is true).
+struct NetRequest
+{
+	std::string url;
+
+	// private browsing, its TLS sessions are kept apart and never saved
+	bool isPrivate = false;
+
+	// extra request headers, eg. "If-None-Match: ..."
+	std::vector<std::string> requestHeaders;
+
+	// warming up for later requests: only resolve the host (into the shared DNS
+	// cache) without connecting, or only send a HEAD and leave the connection
+	bool resolveOnly = false;
+	bool headOnly = false;
+
+	// response data, written by the worker thread (if the body was spilled to
+	// disk, it's empty and spilled has it instead). For streaming requests the
+	// main thread builds the body, and spilled belongs to it alone.
+	std::string body;
+	std::shared_ptr<SpilledBody> spilled;
+	size_t memoryLimit = NETWORK_MEMORY_LIMIT; // 0 to keep any size in memory
+
+	// downloads: write the body straight into this file at outOffset onwards
+	// (as sent, without content decoding, so that byte ranges line up) instead
+	// of into body. Only successful responses are written, and only a 206 if
+	// a Range was asked for. The worker closes the descriptor once it's done.
+	int outFd = -1;
+	size_t outOffset = 0;
+	std::map<std::string, std::string> headers;
+	bool headersReady = false; // streaming: headers can be read from the first onData
+	int httpCode = 0;
+	bool success = false;
+	bool fromCache = false; // served without touching the network
+	int firstByteMs = 0;	// how long the transfer took, up to its first byte
+	int totalMs = 0;		// and in all
+
+	// progress, can be polled from the main thread while in flight. Responses
+	// are decompressed as they stream in, so bytesOnWire (and bytesTotal, from
+	// Content-Length) can be much smaller than the bytesReceived we decode to
+	std::atomic<size_t> bytesReceived { 0 };
+	std::atomic<size_t> bytesOnWire { 0 };
+	std::atomic<size_t> bytesTotal { 0 }; // 0 if the server didn't tell us
+
+	std::atomic<bool> cancelled { false };
+	std::atomic<bool> done { false };
+
+	// invoked on the main thread (from NetworkWorker::drain) unless cancelled
+	std::function<void(NetRequest&)> onComplete;
+
+	// streaming requests hand each chunk to the main thread as it arrives,
+	// instead of the worker building up body itself
+	bool streaming = false;
+	LockFreeQueue<std::string> chunks; // worker -> main
+	std::string received;			   // main thread: everything handed over so far
+
+	// main thread, invoked whenever new chunks were appended to received
+	std::function<void(NetRequest&)> onData;
+
+	// set while this request is waiting on another one's transfer (identical
+	// fetches are coalesced by the HTTP cache), progress is read from that
+	const NetRequest* transfer = nullptr;
+
+	// instead of a transfer, run this on the worker thread (eg. the cache's disk
+	// I/O). Requests are picked up in the order they were submitted, so work
+	// on the same files happens in that order too.
+	std::function<void(NetRequest&)> work;
+
+	// a 0.0 - 1.0 estimate of how far along this request is
+	float progress() const;
+
+	// add to the body (or what has streamed in so far), moving it all out to a
+	// file once it passes memoryLimit
+	void appendBody(std::string& buffer, const char* data, size_t length);
+};
+
+// Runs all page fetches on a dedicated thread using a curl multi handle, so the
+// UI keeps processing input while pages load. Finished requests come back
+// through a lock-free queue that the main loop drains once per frame.
+class NetworkWorker
+{
+public:
+	static NetworkWorker& getInstance();
+
+	void start();
+	void stop();
+
+	// queue a GET for the given url, onComplete runs later on the main thread
+	std::shared_ptr<NetRequest> fetch(const std::string& url,
+		std::function<void(NetRequest&)> onComplete);
+
+	// queue an already set up request (url, headers, callback)
+	void submit(const std::shared_ptr<NetRequest>& request);
+
+	// complete an already filled in request (eg. from a cache) on the next drain
+	void deliver(const std::shared_ptr<NetRequest>& request);
+
+	// queue work for the worker thread (see NetRequest::work), onComplete runs
+	// on the main thread once it's done
+	std::shared_ptr<NetRequest> runOnWorker(std::function<void(NetRequest&)> work,
+		std::function<void(NetRequest&)> onComplete = nullptr);
+
+	// the request will be aborted on the worker, and its callback never invoked
+	void cancel(const std::shared_ptr<NetRequest>& request);
+
+	// main thread: run the callbacks of any completed requests, returns how many
+	int drain();
+
+	// main thread: whether anything is still waiting on the network
+	bool hasPendingRequests() const { return pendingCount > 0; }
+
+private:
+	NetworkWorker() = default;
+	~NetworkWorker();
+
+	void run();
+
+	LockFreeQueue<std::shared_ptr<NetRequest>> incoming;  // main -> worker
+	LockFreeQueue<std::shared_ptr<NetRequest>> completed; // worker -> main
+	std::vector<std::shared_ptr<NetRequest>> streamingRequests; // main thread only
+
+	bool pumpChunks(NetRequest& request);
+
+	std::thread thread;
+	std::atomic<bool> running { false };
+	int pendingCount = 0; // main thread only
+
+#ifndef NETWORK_MOCK
+	CURLM* multi = nullptr;
+
+	struct Transfer
+	{
+		std::shared_ptr<NetRequest> request;
+		curl_slist* headers = nullptr;
+	};
+	std::map<CURL*, Transfer> active; // worker thread only
+
+	void startTransfer(const std::shared_ptr<NetRequest>& request);
+	void finishTransfer(CURL* handle, CURLcode result);
+
+	// requests answered from a NetworkArchive instead of curl, played out over
+	// time as if they were coming in over the network
+	struct Replay
+	{
+		std::shared_ptr<NetRequest> request;
+		const ArchivedResponse* response;
+		std::chrono::steady_clock::time_point nextAt; // when the next segment is due
+		double msPerByte = 0;						  // of the decoded body
+		size_t sent = 0;
+	};
+	std::vector<Replay> replays; // worker thread only
+
+	void startReplay(const std::shared_ptr<NetRequest>& request);
+	int advanceReplays(); // ms until the next segment is due
+#endif
+};
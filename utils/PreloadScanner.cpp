@@ -0,0 +1,254 @@
+#include "PreloadScanner.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <map>
+
+// case-insensitive search for a lowercase needle that starts with '<'
+static const char* findLower(const char* start, const char* end,
+	const std::string& needle)
+{
+	if (needle.empty())
+		return start;
+
+	while (start + needle.size() <= end)
+	{
+		auto hit = (const char*)memchr(start, '<', end - start);
+		if (hit == nullptr || hit + needle.size() > end)
+			return nullptr;
+
+		size_t i = 1;
+		while (i < needle.size() && tolower((unsigned char)hit[i]) == needle[i])
+			i++;
+		if (i == needle.size())
+			return hit;
+		start = hit + 1;
+	}
+	return nullptr;
+}
+
+// the '>' that closes a tag, skipping over any inside quoted attribute values
+static const char* findTagEnd(const char* start, const char* end)
+{
+	char quote = 0;
+	for (auto p = start; p < end; p++)
+	{
+		if (quote)
+		{
+			if (*p == quote)
+				quote = 0;
+		}
+		else if (*p == '"' || *p == '\'')
+			quote = *p;
+		else if (*p == '>')
+			return p;
+	}
+	return nullptr;
+}
+
+static std::string decodeEntities(const std::string& value)
+{
+	// urls mostly only ever contain &amp;
+	std::string out;
+	size_t pos = 0, amp;
+	while ((amp = value.find("&amp;", pos)) != std::string::npos)
+	{
+		out.append(value, pos, amp - pos);
+		out += '&';
+		pos = amp + 5;
+	}
+	out.append(value, pos, std::string::npos);
+	return out;
+}
+
+static std::map<std::string, std::string> parseAttributes(const char* p,
+	const char* end)
+{
+	std::map<std::string, std::string> attributes;
+	while (p < end)
+	{
+		while (p < end && (isspace((unsigned char)*p) || *p == '/'))
+			p++;
+
+		std::string name;
+		while (p < end && !isspace((unsigned char)*p) && *p != '=' && *p != '/')
+			name += tolower((unsigned char)*p++);
+		if (name.empty())
+			break;
+
+		while (p < end && isspace((unsigned char)*p))
+			p++;
+
+		std::string value;
+		if (p < end && *p == '=')
+		{
+			p++;
+			while (p < end && isspace((unsigned char)*p))
+				p++;
+			if (p < end && (*p == '"' || *p == '\''))
+			{
+				char quote = *p++;
+				auto close = (const char*)memchr(p, quote, end - p);
+				if (close == nullptr)
+					close = end;
+				value.assign(p, close);
+				p = close + 1;
+			}
+			else
+			{
+				auto start = p;
+				while (p < end && !isspace((unsigned char)*p))
+					p++;
+				value.assign(start, p);
+			}
+		}
+
+		attributes.emplace(name, decodeEntities(value));
+	}
+	return attributes;
+}
+
+static std::string lower(std::string value)
+{
+	for (auto& c : value)
+		c = tolower((unsigned char)c);
+	return value;
+}
+
+// whether a space separated rel list contains the given token
+static bool hasToken(const std::string& list, const std::string& token)
+{
+	size_t pos = 0;
+	while ((pos = list.find(token, pos)) != std::string::npos)
+	{
+		bool startOk = pos == 0 || isspace((unsigned char)list[pos - 1]);
+		size_t after = pos + token.size();
+		bool endOk = after == list.size() || isspace((unsigned char)list[after]);
+		if (startOk && endOk)
+			return true;
+		pos = after;
+	}
+	return false;
+}
+
+void PreloadScanner::reset()
+{
+	position = 0;
+	rawTextEnd.clear();
+}
+
+std::vector<PreloadResource> PreloadScanner::scan(const std::string& html)
+{
+	std::vector<PreloadResource> found;
+	const char* base = html.data();
+	const char* end = base + html.size();
+
+	if (position > html.size())
+		reset();
+
+	while (position < html.size())
+	{
+		const char* p = base + position;
+
+		// inside <script> or <style>, nothing is markup until the closing tag
+		if (!rawTextEnd.empty())
+		{
+			auto close = findLower(p, end, rawTextEnd);
+			if (close == nullptr)
+			{
+				// keep a little back, in case the closing tag is split across chunks
+				if ((size_t)(end - p) > rawTextEnd.size())
+					position = html.size() - rawTextEnd.size();
+				break;
+			}
+			position = close - base + rawTextEnd.size();
+			rawTextEnd.clear();
+			continue;
+		}
+
+		auto open = (const char*)memchr(p, '<', end - p);
+		if (open == nullptr)
+		{
+			position = html.size();
+			break;
+		}
+		position = open - base;
+
+		if (end - open < 4)
+			break; // wait for more
+
+		if (open[1] == '!' && open[2] == '-' && open[3] == '-')
+		{
+			auto close = html.find("-->", position + 4);
+			if (close == std::string::npos)
+				break;
+			position = close + 3;
+			continue;
+		}
+
+		// only opening tags are interesting
+		if (!isalpha((unsigned char)open[1]))
+		{
+			position++;
+			continue;
+		}
+
+		auto tagEnd = findTagEnd(open + 1, end);
+		if (tagEnd == nullptr)
+			break; // tag isn't all here yet
+
+		auto nameEnd = open + 1;
+		while (nameEnd < tagEnd && !isspace((unsigned char)*nameEnd) && *nameEnd != '/')
+			nameEnd++;
+		auto name = lower(std::string(open + 1, nameEnd));
+
+		scanTag(name, nameEnd, tagEnd - nameEnd, found);
+		position = tagEnd - base + 1;
+
+		if (name == "script" || name == "style" || name == "textarea" || name == "title")
+			rawTextEnd = "</" + name;
+	}
+
+	return found;
+}
+
+void PreloadScanner::scanTag(const std::string& name, const char* attributes,
+	size_t length, std::vector<PreloadResource>& found)
+{
+	if (name != "link" && name != "img" && name != "script")
+		return;
+
+	auto attrs = parseAttributes(attributes, attributes + length);
+
+	if (name == "img")
+	{
+		auto src = attrs.find("src");
+		if (src != attrs.end() && !src->second.empty())
+			found.push_back({ PRELOAD_IMAGE, src->second, lower(attrs["loading"]) == "lazy" });
+	}
+	else if (name == "script")
+	{
+		auto src = attrs.find("src");
+		if (src != attrs.end() && !src->second.empty())
+			found.push_back({ PRELOAD_SCRIPT, src->second });
+	}
+	else
+	{
+		auto href = attrs.find("href");
+		if (href == attrs.end() || href->second.empty())
+			return;
+
+		auto rel = lower(attrs["rel"]);
+		if (hasToken(rel, "stylesheet") && !hasToken(rel, "alternate"))
+			found.push_back({ PRELOAD_STYLESHEET, href->second });
+		else if (hasToken(rel, "preload"))
+		{
+			auto as = lower(attrs["as"]);
+			auto kind = as == "style" ? PRELOAD_STYLESHEET
+				: as == "script"	  ? PRELOAD_SCRIPT
+				: as == "image"		  ? PRELOAD_IMAGE
+									  : PRELOAD_OTHER;
+			found.push_back({ kind, href->second });
+		}
+	}
+}
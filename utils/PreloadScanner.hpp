@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+enum PreloadKind
+{
+	PRELOAD_STYLESHEET,
+	PRELOAD_SCRIPT,
+	PRELOAD_IMAGE,
+	PRELOAD_OTHER, // <link rel=preload> of some other type
+};
+
+struct PreloadResource
+{
+	PreloadKind kind;
+	std::string url; // as written in the markup, not resolved yet
+	bool lazy = false; // <img loading=lazy>
+};
+
+// A lookahead scanner that picks subresource urls out of HTML as it streams in,
+// without building any DOM. It only looks at tags (jumping between them with
+// memchr), skips comments and the contents of <script>/<style>, and remembers
+// where it stopped so each call only scans the newly arrived bytes.
+class PreloadScanner
+{
+public:
+	// scan whatever was appended to html since the last call
+	std::vector<PreloadResource> scan(const std::string& html);
+
+	void reset();
+
+private:
+	size_t position = 0;
+	std::string rawTextEnd; // eg. "</script" while inside a script's contents
+
+	void scanTag(const std::string& name, const char* attributes, size_t length,
+		std::vector<PreloadResource>& found);
+};
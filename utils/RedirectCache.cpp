@@ -0,0 +1,117 @@
+#include "RedirectCache.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#define REDIRECT_CACHE_PATH "./data/redirects.txt"
+
+RedirectCache& RedirectCache::getInstance()
+{
+	static RedirectCache instance;
+	return instance;
+}
+
+void RedirectCache::ensureLoaded()
+{
+	if (loaded)
+		return;
+	loaded = true;
+
+	// one "from to" per line, oldest first (urls are already uri encoded)
+	std::istringstream saved(readFile(REDIRECT_CACHE_PATH));
+	std::string from, to;
+	while (saved >> from >> to)
+		entries[from] = { to, nextOrder++ };
+}
+
+void RedirectCache::save()
+{
+	std::vector<std::pair<uint64_t, const std::string*>> byAge;
+	for (auto& [from, redirect] : entries)
+		byAge.push_back({ redirect.order, &from });
+	std::sort(byAge.begin(), byAge.end());
+
+	std::ostringstream out;
+	for (auto& [order, from] : byAge)
+		out << *from << " " << entries[*from].target << "\n";
+	writeFile(REDIRECT_CACHE_PATH, out.str());
+}
+
+std::string RedirectCache::resolve(const std::string& url)
+{
+	ensureLoaded();
+
+	std::string current = url;
+	std::set<std::string> seen = { url };
+	for (int hop = 0; hop < REDIRECT_CACHE_MAX_HOPS; hop++)
+	{
+		auto it = entries.find(current);
+		if (it == entries.end())
+			break;
+
+		// the site changed its mind and now points back, start over from the top
+		if (seen.count(it->second.target))
+		{
+			std::cout << "[RedirectCache] Dropping redirect loop at " << current
+					  << std::endl;
+			forget(current);
+			return url;
+		}
+
+		current = it->second.target;
+		seen.insert(current);
+	}
+
+	if (current != url)
+		std::cout << "[RedirectCache] " << url << " -> " << current << std::endl;
+	return current;
+}
+
+void RedirectCache::record(const std::string& from, const std::string& to)
+{
+	if (from == to || to.empty())
+		return;
+
+	ensureLoaded();
+	auto existing = entries.find(from);
+	if (existing != entries.end() && existing->second.target == to)
+		return;
+
+	// older redirects that lead from the new target back here are out of date
+	// (otherwise the two would send us round in circles)
+	std::vector<std::string> chain;
+	for (auto it = entries.find(to); it != entries.end() && chain.size() < REDIRECT_CACHE_MAX_HOPS;
+		 it = entries.find(it->second.target))
+	{
+		chain.push_back(it->first);
+		if (it->second.target == from)
+		{
+			for (auto& stale : chain)
+				entries.erase(stale);
+			break;
+		}
+	}
+
+	entries[from] = { to, nextOrder++ };
+
+	while (entries.size() > REDIRECT_CACHE_MAX_ENTRIES)
+	{
+		auto oldest = std::min_element(entries.begin(), entries.end(),
+			[](const auto& a, const auto& b)
+			{ return a.second.order < b.second.order; });
+		entries.erase(oldest);
+	}
+
+	save();
+}
+
+void RedirectCache::forget(const std::string& url)
+{
+	ensureLoaded();
+	if (entries.erase(url))
+		save();
+}
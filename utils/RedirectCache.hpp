@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// permanent redirects remembered at once (the oldest are forgotten first)
+#define REDIRECT_CACHE_MAX_ENTRIES 512
+// how many remembered redirects can be chained together
+#define REDIRECT_CACHE_MAX_HOPS 8
+
+// Remembers 301/308 redirects so that the next visit to the old url goes
+// straight to where it ended up, without asking the server again. Kept in
+// ./data/redirects.txt. Main thread only.
+class RedirectCache
+{
+public:
+	static RedirectCache& getInstance();
+
+	// where url ends up, following any remembered redirects (or url itself)
+	std::string resolve(const std::string& url);
+
+	void record(const std::string& from, const std::string& to);
+	void forget(const std::string& url);
+
+private:
+	RedirectCache() = default;
+
+	struct Redirect
+	{
+		std::string target;
+		uint64_t order = 0; // when it was recorded
+	};
+	std::map<std::string, Redirect> entries;
+	uint64_t nextOrder = 0;
+	bool loaded = false;
+
+	void ensureLoaded();
+	void save();
+};
@@ -0,0 +1,279 @@
+#include "RequestScheduler.hpp"
+#include "HttpCache.hpp"
+#include "NetworkWorker.hpp"
+
+#include <algorithm>
+
+RequestScheduler& RequestScheduler::getInstance()
+{
+	static RequestScheduler instance;
+	return instance;
+}
+
+std::shared_ptr<ScheduledFetch> RequestScheduler::fetch(const std::string& url,
+	bool isPrivate, FetchPriority priority, const void* owner,
+	std::function<void(NetRequest&)> onComplete,
+	std::function<void(NetRequest&)> onData, bool revalidate)
+{
+	if (!revalidate)
+	{
+		auto adopted = adoptPreload(url, isPrivate, priority, owner, onComplete, onData);
+		if (adopted != nullptr)
+			return adopted;
+	}
+
+	auto fetch = std::make_shared<ScheduledFetch>();
+	fetch->url = url;
+	fetch->isPrivate = isPrivate;
+	fetch->revalidate = revalidate;
+	fetch->priority = priority;
+	fetch->owner = owner;
+	fetch->order = nextOrder++;
+	fetch->onComplete = onComplete;
+	fetch->onData = onData;
+
+	// nothing else on the page can start without the document, so it never waits
+	if (bypassesCap(priority))
+	{
+		start(fetch);
+		return fetch;
+	}
+
+	// the rest waits for the next pump, by which point the page has been laid
+	// out and images know whether they're on screen
+	queue.push_back(fetch);
+	needsSort = true;
+	return fetch;
+}
+
+std::shared_ptr<ScheduledFetch> RequestScheduler::preload(const std::string& url,
+	bool isPrivate, FetchPriority priority, const void* owner,
+	std::function<void(NetRequest&)> onComplete)
+{
+	if (preloads.count(url))
+		return nullptr;
+
+	auto fetch = std::make_shared<ScheduledFetch>();
+	fetch->url = url;
+	fetch->isPrivate = isPrivate;
+	fetch->priority = priority;
+	fetch->owner = owner;
+	fetch->order = nextOrder++;
+	fetch->onComplete = onComplete;
+	fetch->speculative = true;
+
+	preloads[url] = fetch;
+
+	// a link's document only helps if it's on its way before the tap completes,
+	// so it doesn't wait behind the images of the page it's on
+	if (bypassesCap(priority))
+	{
+		start(fetch);
+		return fetch;
+	}
+
+	queue.push_back(fetch);
+	needsSort = true;
+	return fetch;
+}
+
+std::shared_ptr<NetRequest> RequestScheduler::preloaded(const std::string& url,
+	bool isPrivate)
+{
+	auto it = preloads.find(url);
+	if (it == preloads.end() || it->second->isPrivate != isPrivate || !it->second->finished)
+		return nullptr;
+
+	auto& response = it->second->request;
+	if (!response->success || response->httpCode >= 400)
+		return nullptr;
+	return response;
+}
+
+std::shared_ptr<ScheduledFetch> RequestScheduler::adoptPreload(
+	const std::string& url, bool isPrivate, FetchPriority priority,
+	const void* owner, std::function<void(NetRequest&)> onComplete,
+	std::function<void(NetRequest&)> onData)
+{
+	auto it = preloads.find(url);
+	if (it == preloads.end() || it->second->isPrivate != isPrivate)
+		return nullptr;
+
+	auto fetch = it->second;
+	preloads.erase(it);
+	fetch->speculative = false;
+	fetch->owner = owner;
+
+	if (!fetch->finished)
+	{
+		// still on its way, so just become the caller's fetch (a preload that's
+		// already running won't stream to onData, only complete)
+		fetch->onComplete = onComplete;
+		fetch->onData = onData;
+		if (priority < fetch->priority)
+			setPriority(fetch, priority);
+
+		// a prefetched document that hasn't left the queue yet doesn't wait
+		// behind the subresources any longer
+		if (priority == PRIORITY_DOCUMENT && fetch->request == nullptr)
+		{
+			queue.erase(std::remove(queue.begin(), queue.end(), fetch), queue.end());
+			start(fetch);
+		}
+		return fetch;
+	}
+
+	// already here, hand over a copy on the next drain (the preload's own
+	// callback already accounted for the transfer). Until then it counts as
+	// active, so that cancelAll can still stop the callback.
+	auto handle = std::make_shared<ScheduledFetch>();
+	handle->url = url;
+	handle->isPrivate = isPrivate;
+	handle->priority = priority;
+	handle->owner = owner;
+	handle->onComplete = onComplete;
+
+	auto& preloadedResponse = *fetch->request;
+	auto response = std::make_shared<NetRequest>();
+	response->url = url;
+	response->body = std::move(preloadedResponse.body);
+	response->spilled = preloadedResponse.spilled;
+	response->headers = preloadedResponse.headers;
+	response->httpCode = preloadedResponse.httpCode;
+	response->success = preloadedResponse.success;
+	response->fromCache = true;
+	response->onComplete = [this, handle](NetRequest& delivered)
+	{
+		finish(*handle);
+		handle->finished = true;
+		if (handle->onComplete)
+			handle->onComplete(delivered);
+		handle->onComplete = nullptr;
+	};
+
+	handle->request = response;
+	active.push_back(handle);
+	NetworkWorker::getInstance().deliver(response);
+	return handle;
+}
+
+void RequestScheduler::setPriority(const std::shared_ptr<ScheduledFetch>& fetch,
+	FetchPriority priority)
+{
+	if (fetch == nullptr || fetch->priority == priority)
+		return;
+
+	fetch->priority = priority;
+	if (fetch->request == nullptr)
+		needsSort = true;
+}
+
+void RequestScheduler::cancel(const std::shared_ptr<ScheduledFetch>& fetch)
+{
+	if (fetch == nullptr || fetch->cancelled)
+		return;
+	fetch->cancelled = true;
+
+	if (fetch->speculative)
+	{
+		auto it = preloads.find(fetch->url);
+		if (it != preloads.end() && it->second == fetch)
+			preloads.erase(it);
+	}
+
+	if (fetch->request == nullptr)
+		queue.erase(std::remove(queue.begin(), queue.end(), fetch), queue.end());
+	else
+	{
+		HttpCache::getInstance(fetch->isPrivate).cancel(fetch->request);
+		finish(*fetch);
+	}
+
+	// release anything the callbacks captured
+	fetch->onComplete = nullptr;
+	fetch->onData = nullptr;
+}
+
+void RequestScheduler::cancelAll(const void* owner)
+{
+	std::vector<std::shared_ptr<ScheduledFetch>> owned;
+	for (auto& fetch : queue)
+		if (fetch->owner == owner)
+			owned.push_back(fetch);
+	for (auto& fetch : active)
+		if (fetch->owner == owner)
+			owned.push_back(fetch);
+	for (auto& [url, fetch] : preloads)
+		if (fetch->owner == owner && fetch->finished)
+			owned.push_back(fetch);
+
+	for (auto& fetch : owned)
+		cancel(fetch);
+}
+
+int RequestScheduler::activeSubresources() const
+{
+	return (int)std::count_if(active.begin(), active.end(),
+		[](const auto& fetch)
+		{ return !bypassesCap(fetch->priority); });
+}
+
+bool RequestScheduler::bypassesCap(FetchPriority priority)
+{
+	return priority == PRIORITY_DOCUMENT || priority == PRIORITY_PREFETCH;
+}
+
+void RequestScheduler::pump()
+{
+	if (queue.empty())
+		return;
+
+	if (needsSort)
+	{
+		// most important (lowest priority, then earliest) at the back
+		std::sort(queue.begin(), queue.end(),
+			[](const auto& a, const auto& b)
+			{
+				if (a->priority != b->priority)
+					return a->priority > b->priority;
+				return a->order > b->order;
+			});
+		needsSort = false;
+	}
+
+	int running = activeSubresources();
+	while (!queue.empty() && running < SCHEDULER_MAX_IN_FLIGHT)
+	{
+		auto next = queue.back();
+		queue.pop_back();
+		start(next);
+		running++;
+	}
+}
+
+void RequestScheduler::start(const std::shared_ptr<ScheduledFetch>& fetch)
+{
+	active.push_back(fetch);
+
+	// the callback holds on to the fetch until the request is drained
+	auto& cache = HttpCache::getInstance(fetch->isPrivate);
+	fetch->request = cache.fetch(fetch->url, fetch->revalidate,
+		[this, fetch](NetRequest& response)
+		{
+			finish(*fetch);
+			fetch->finished = true;
+			if (fetch->onComplete)
+				fetch->onComplete(response);
+			fetch->onComplete = nullptr;
+			fetch->onData = nullptr;
+		},
+		fetch->onData);
+}
+
+void RequestScheduler::finish(ScheduledFetch& fetch)
+{
+	active.erase(std::remove_if(active.begin(), active.end(),
+					 [&fetch](const auto& other)
+					 { return other.get() == &fetch; }),
+		active.end());
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct NetRequest;
+
+// how many subresource fetches can be on the network at once (documents, and
+// prefetches of documents, don't count against this, they always start right away)
+#define SCHEDULER_MAX_IN_FLIGHT 6
+
+// lower values are fetched first
+enum FetchPriority
+{
+	PRIORITY_DOCUMENT,
+	PRIORITY_STYLESHEET,
+	PRIORITY_VISIBLE,		// images inside the viewport
+	PRIORITY_NEAR_VIEWPORT, // images within a screen of the viewport
+	PRIORITY_PREFETCH,		// a link that's about to be followed
+	PRIORITY_BACKGROUND,	// everything else
+};
+
+// A fetch waiting in (or started by) the scheduler
+struct ScheduledFetch
+{
+	std::string url;
+	bool isPrivate = false;
+	bool revalidate = false;
+
+	FetchPriority priority = PRIORITY_BACKGROUND;
+	const void* owner = nullptr; // eg. the WebView, to cancel everything it asked for
+	uint64_t order = 0;			 // submission order, breaks ties within a priority
+
+	std::function<void(NetRequest&)> onComplete;
+	std::function<void(NetRequest&)> onData;
+
+	// set once the fetch leaves the queue
+	std::shared_ptr<NetRequest> request;
+	bool cancelled = false;
+	bool finished = false;
+
+	// started by the preload scanner, before anything on the page asked for it
+	bool speculative = false;
+};
+
+// Orders all page fetches (through the HTTP cache) by priority, and caps how
+// many subresources are on the network at once so that the document, its
+// stylesheets and the images on screen aren't stuck behind ones far below.
+// Main thread only.
+class RequestScheduler
+{
+public:
+	static RequestScheduler& getInstance();
+
+	// queue a fetch, onComplete runs on the main thread once it has finished
+	std::shared_ptr<ScheduledFetch> fetch(const std::string& url, bool isPrivate,
+		FetchPriority priority, const void* owner,
+		std::function<void(NetRequest&)> onComplete,
+		std::function<void(NetRequest&)> onData = nullptr,
+		bool revalidate = false);
+
+	// fetch something the page is going to ask for soon. A later fetch() of the
+	// same url takes over the preload instead of starting another request.
+	// Returns nullptr if the url is already being preloaded.
+	std::shared_ptr<ScheduledFetch> preload(const std::string& url, bool isPrivate,
+		FetchPriority priority, const void* owner,
+		std::function<void(NetRequest&)> onComplete = nullptr);
+
+	// the response of a finished preload, if there is one from the same
+	// partition and it isn't an error page (not consumed)
+	std::shared_ptr<NetRequest> preloaded(const std::string& url, bool isPrivate);
+
+	// move a queued fetch up or down (eg. as its image scrolls into view)
+	void setPriority(const std::shared_ptr<ScheduledFetch>& fetch,
+		FetchPriority priority);
+
+	// drop a fetch whether it's queued or already on the network
+	void cancel(const std::shared_ptr<ScheduledFetch>& fetch);
+	void cancelAll(const void* owner);
+
+	// start the most important queued fetches, up to the concurrency cap
+	void pump();
+
+	bool hasQueued() const { return !queue.empty(); }
+
+private:
+	RequestScheduler() = default;
+
+	std::vector<std::shared_ptr<ScheduledFetch>> queue;  // most important last
+	std::vector<std::shared_ptr<ScheduledFetch>> active; // started, not finished
+	std::map<std::string, std::shared_ptr<ScheduledFetch>> preloads; // not yet asked for
+	bool needsSort = false;
+	uint64_t nextOrder = 0;
+
+	int activeSubresources() const;
+	static bool bypassesCap(FetchPriority priority);
+
+	std::shared_ptr<ScheduledFetch> adoptPreload(const std::string& url,
+		bool isPrivate, FetchPriority priority, const void* owner,
+		std::function<void(NetRequest&)> onComplete,
+		std::function<void(NetRequest&)> onData);
+	void start(const std::shared_ptr<ScheduledFetch>& fetch);
+	void finish(ScheduledFetch& fetch);
+};
@@ -0,0 +1,120 @@
+#include "StylesheetCache.hpp"
+#include "HttpCache.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+// resinfs support, if present
+#if defined(USE_RAMFS)
+#define RAMFS "resin:/"
+#else
+#define RAMFS "resin/"
+#endif
+
+StylesheetCache& StylesheetCache::getInstance(bool isPrivate)
+{
+	static StylesheetCache sharedCache(false);
+	static StylesheetCache privateCache(true);
+	return isPrivate ? privateCache : sharedCache;
+}
+
+StylesheetCache::StylesheetCache(bool isPrivate)
+	: isPrivate(isPrivate)
+{
+}
+
+const std::string& StylesheetCache::masterCss()
+{
+	// (it never changes while running, so there's nothing to check it against)
+	if (masterLoaded)
+	{
+		masterReuses++;
+		return master;
+	}
+
+	master = readFile(RAMFS "res/master.css");
+	masterLoaded = true;
+	std::cout << "[StylesheetCache] Loaded master.css (" << master.size()
+			  << " bytes)" << std::endl;
+	return master;
+}
+
+bool StylesheetCache::lookup(const std::string& url, std::string& text)
+{
+	// no fresh response in the HTTP cache means it has to be fetched anyway
+	auto validator = HttpCache::getInstance(isPrivate).validator(url);
+	auto it = entries.find(url);
+	if (it == entries.end() || validator.empty() || it->second.validator != validator)
+	{
+		if (it != entries.end())
+			remove(url);
+		misses++;
+		return false;
+	}
+
+	hits++;
+	bytesSaved += it->second.text->size();
+	it->second.lastUse = ++useCounter;
+	text = *it->second.text;
+	return true;
+}
+
+void StylesheetCache::store(const std::string& url, const std::string& text)
+{
+	// only keep what the HTTP cache kept too, so there's something to validate
+	// against (and no-store sheets stay unstored)
+	auto validator = HttpCache::getInstance(isPrivate).validator(url);
+	if (validator.empty() || text.size() > STYLESHEET_CACHE_MEMORY_LIMIT / 4)
+		return;
+
+	remove(url);
+	evictToFit(text.size());
+
+	CachedStylesheet entry;
+	entry.validator = validator;
+	entry.text = std::make_shared<const std::string>(text);
+	entry.lastUse = ++useCounter;
+
+	totalBytes += text.size();
+	entries[url] = entry;
+}
+
+void StylesheetCache::remove(const std::string& url)
+{
+	auto it = entries.find(url);
+	if (it == entries.end())
+		return;
+
+	totalBytes -= it->second.text->size();
+	entries.erase(it);
+}
+
+void StylesheetCache::evictToFit(size_t incoming)
+{
+	while (!entries.empty() && totalBytes + incoming > STYLESHEET_CACHE_MEMORY_LIMIT)
+	{
+		auto oldest = std::min_element(entries.begin(), entries.end(),
+			[](const auto& a, const auto& b)
+			{ return a.second.lastUse < b.second.lastUse; });
+		remove(oldest->first);
+	}
+}
+
+void StylesheetCache::clear()
+{
+	entries.clear();
+	totalBytes = 0;
+}
+
+void StylesheetCache::logStats() const
+{
+	if (hits == 0 && misses == 0)
+		return;
+
+	std::cout << "[StylesheetCache] " << hits << " hits, " << misses
+			  << " misses, " << bytesSaved / 1024 << "KB not reloaded ("
+			  << entries.size() << " sheets, " << totalBytes / 1024
+			  << "KB kept), master.css reused " << masterReuses << " times"
+			  << std::endl;
+}
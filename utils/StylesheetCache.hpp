@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+// external stylesheets kept in memory between pages, sites tend to share a few
+// big ones across every page
+#define STYLESHEET_CACHE_MEMORY_LIMIT 0x400000
+
+struct CachedStylesheet
+{
+	std::string validator; // from the HTTP cache entry the text came from
+	std::shared_ptr<const std::string> text;
+	uint64_t lastUse = 0;
+};
+
+// Stylesheets that documents have already loaded, shared by every tab, so a new
+// page on the same site doesn't read (and inflate) the same CSS out of the HTTP
+// cache again. Entries are keyed by url and only served while the HTTP cache
+// still has the same response fresh. There are two partitions, like HttpCache.
+// Main thread only.
+class StylesheetCache
+{
+public:
+	static StylesheetCache& getInstance(bool isPrivate = false);
+
+	// the built-in res/master.css, read from disk the first time only
+	const std::string& masterCss();
+
+	// the text of a sheet loaded before, if it's still what the server sent
+	bool lookup(const std::string& url, std::string& text);
+
+	// remember a sheet that was just fetched (through the HTTP cache)
+	void store(const std::string& url, const std::string& text);
+
+	void clear();
+	void logStats() const;
+
+	// counters for debugging (of external sheets, master.css is counted apart)
+	int hits = 0;
+	int misses = 0;
+	size_t bytesSaved = 0; // sheet text that didn't have to be loaded again
+	int masterReuses = 0;  // documents that got master.css without a read
+
+private:
+	StylesheetCache(bool isPrivate);
+
+	bool isPrivate;
+	std::map<std::string, CachedStylesheet> entries;
+	size_t totalBytes = 0;
+	uint64_t useCounter = 0;
+
+	std::string master;
+	bool masterLoaded = false;
+
+	void remove(const std::string& url);
+	void evictToFit(size_t incoming);
+};
@@ -0,0 +1,205 @@
+#include "TextRenderer.hpp"
+#include "../libs/chesto/src/RootDisplay.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+TextRenderer& TextRenderer::getInstance()
+{
+	static TextRenderer instance;
+	return instance;
+}
+
+void TextRenderer::reset()
+{
+	// what's queued still needs the glyphs that are about to be overwritten
+	flush();
+	glyphs.clear();
+	shelfX = 0;
+	shelfY = 0;
+	shelfHeight = 0;
+	resets++;
+}
+
+const TextRenderer::Glyph* TextRenderer::glyph(CachedFont* font, const char* bytes, size_t length)
+{
+	uint32_t packed = 0;
+	for (size_t x = 0; x < length; x++)
+		packed = (packed << 8) | (unsigned char)bytes[x];
+	uint64_t key = ((uint64_t)font->id << 32) | packed;
+
+	auto known = glyphs.find(key);
+	if (known != glyphs.end())
+		return &known->second;
+
+	// white, so that the vertex color tints it to whatever the text is
+	auto text = std::string(bytes, length);
+	auto rendered = TTF_RenderUTF8_Blended(font->ttf, text.c_str(), { 0xff, 0xff, 0xff, 0xff });
+	if (rendered == nullptr)
+		return nullptr;
+	auto surface = SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(rendered);
+	if (surface == nullptr)
+		return nullptr;
+
+	if (surface->w > TEXT_ATLAS_SIZE || surface->h > TEXT_ATLAS_SIZE)
+	{
+		SDL_FreeSurface(surface);
+		return nullptr;
+	}
+
+	// next shelf, or start the atlas over if there's no room left
+	if (shelfX + surface->w > TEXT_ATLAS_SIZE)
+	{
+		shelfX = 0;
+		shelfY += shelfHeight;
+		shelfHeight = 0;
+	}
+	if (shelfY + surface->h > TEXT_ATLAS_SIZE)
+		reset();
+
+	Glyph placed;
+	placed.x = shelfX;
+	placed.y = shelfY;
+	placed.w = surface->w;
+	placed.h = surface->h;
+	SDL_Rect area = { placed.x, placed.y, placed.w, placed.h };
+	SDL_UpdateTexture(atlas, &area, surface->pixels, surface->pitch);
+	SDL_FreeSurface(surface);
+
+	shelfX += placed.w;
+	shelfHeight = std::max(shelfHeight, placed.h);
+	rasterized++;
+	return &(glyphs[key] = placed);
+}
+
+bool TextRenderer::queue(CachedFont* font, const char* text, float x, float y, SDL_Color color)
+{
+#ifdef TEXT_RENDERER_GEOMETRY
+	if (unsupported || font == nullptr || font->ttf == nullptr)
+		return false;
+
+	if (atlas == nullptr)
+	{
+		auto renderer = RootDisplay::mainDisplay->renderer;
+		atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+			SDL_TEXTUREACCESS_STATIC, TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE);
+		if (atlas == nullptr)
+		{
+			std::cout << "[TextRenderer] Can't create the glyph atlas: " << SDL_GetError() << std::endl;
+			unsupported = true;
+			return false;
+		}
+		SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+	}
+
+	runs++;
+	float pen = x;
+	size_t length = strlen(text);
+	for (size_t at = 0; at < length;)
+	{
+		size_t size = std::min(utf8Length(text[at]), length - at);
+		const char* bytes = &text[at];
+		at += size;
+
+		// nothing to draw, just move along
+		int advance = font->advance(bytes, size);
+		if (size == 1 && (*bytes == ' ' || *bytes == '\t'))
+		{
+			pen += advance;
+			continue;
+		}
+
+		auto placed = glyph(font, bytes, size);
+		if (placed != nullptr)
+		{
+			float left = pen, top = y;
+			float right = left + placed->w, bottom = top + placed->h;
+			float u0 = (float)placed->x / TEXT_ATLAS_SIZE, v0 = (float)placed->y / TEXT_ATLAS_SIZE;
+			float u1 = (float)(placed->x + placed->w) / TEXT_ATLAS_SIZE;
+			float v1 = (float)(placed->y + placed->h) / TEXT_ATLAS_SIZE;
+
+			int first = (int)vertices.size();
+			vertices.push_back({ { left, top }, color, { u0, v0 } });
+			vertices.push_back({ { right, top }, color, { u1, v0 } });
+			vertices.push_back({ { right, bottom }, color, { u1, v1 } });
+			vertices.push_back({ { left, bottom }, color, { u0, v1 } });
+			for (int corner : { 0, 1, 2, 0, 2, 3 })
+				indices.push_back(first + corner);
+		}
+		pen += advance;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void TextRenderer::flush()
+{
+#ifdef TEXT_RENDERER_GEOMETRY
+	if (indices.empty())
+		return;
+
+	auto renderer = RootDisplay::mainDisplay->renderer;
+	if (SDL_RenderGeometry(renderer, atlas, vertices.data(), (int)vertices.size(),
+			indices.data(), (int)indices.size())
+		!= 0)
+	{
+		// the renderer doesn't do geometry after all, draw these a quad at a
+		// time, and everything after the old way
+		std::cout << "[TextRenderer] No geometry support, falling back: " << SDL_GetError() << std::endl;
+		unsupported = true;
+		drawEach();
+	}
+	batches++;
+
+	vertices.clear();
+	indices.clear();
+#endif
+}
+
+#ifdef TEXT_RENDERER_GEOMETRY
+void TextRenderer::drawEach()
+{
+	auto renderer = RootDisplay::mainDisplay->renderer;
+	for (size_t x = 0; x + 3 < vertices.size(); x += 4)
+	{
+		auto& topLeft = vertices[x];
+		auto& bottomRight = vertices[x + 2];
+		SDL_Rect source = {
+			(int)(topLeft.tex_coord.x * TEXT_ATLAS_SIZE),
+			(int)(topLeft.tex_coord.y * TEXT_ATLAS_SIZE),
+			(int)((bottomRight.tex_coord.x - topLeft.tex_coord.x) * TEXT_ATLAS_SIZE + 0.5f),
+			(int)((bottomRight.tex_coord.y - topLeft.tex_coord.y) * TEXT_ATLAS_SIZE + 0.5f)
+		};
+		SDL_FRect dest = { topLeft.position.x, topLeft.position.y,
+			bottomRight.position.x - topLeft.position.x,
+			bottomRight.position.y - topLeft.position.y };
+		SDL_SetTextureColorMod(atlas, topLeft.color.r, topLeft.color.g, topLeft.color.b);
+		SDL_SetTextureAlphaMod(atlas, topLeft.color.a);
+		SDL_RenderCopyF(renderer, atlas, &source, &dest);
+	}
+	SDL_SetTextureColorMod(atlas, 0xff, 0xff, 0xff);
+	SDL_SetTextureAlphaMod(atlas, 0xff);
+}
+#endif
+
+void TextRenderer::logStats()
+{
+	if (runs == 0)
+		return;
+
+	std::cout << "[TextRenderer] " << runs << " text run" << plural(runs) << " in "
+			  << batches << " batch" << (batches == 1 ? "" : "es") << ", " << rasterized
+			  << " glyph" << plural(rasterized) << " rasterized, " << resets
+			  << " atlas reset" << plural(resets) << std::endl;
+
+	runs = 0;
+	batches = 0;
+	rasterized = 0;
+	resets = 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "FontCache.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// one square texture holds the glyphs of every font (it starts over when full)
+#define TEXT_ATLAS_SIZE 1024
+
+// SDL_RenderGeometry is new in 2.0.18, older SDL draws text the old way
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+#define TEXT_RENDERER_GEOMETRY
+#endif
+
+// Draws page text in batches: glyphs from all fonts are rasterized once (in
+// white) into a shared atlas, and each run of text becomes quads tinted by their
+// vertex color, so everything queued between two flushes is a single draw call
+// instead of one per run (and one effect per colored run). Glyphs are placed by
+// the same advances that text_width measured with, so drawing matches layout.
+// Main thread only.
+class TextRenderer
+{
+public:
+	static TextRenderer& getInstance();
+
+	// add a run of text with its top left at x, y, false if it can't be batched
+	// here (and should be drawn directly)
+	bool queue(CachedFont* font, const char* text, float x, float y, SDL_Color color);
+
+	// draw everything queued, before anything that should end up on top of it
+	void flush();
+
+	// counters for debugging
+	int runs = 0;
+	int batches = 0;
+	int rasterized = 0;
+	int resets = 0;
+	void logStats();
+
+private:
+	TextRenderer() = default;
+
+	// where a glyph is in the atlas
+	struct Glyph
+	{
+		int x = 0, y = 0, w = 0, h = 0;
+	};
+	std::unordered_map<uint64_t, Glyph> glyphs; // by font id and UTF-8 bytes
+
+	SDL_Texture* atlas = nullptr;
+	bool unsupported = false; // the renderer can't draw geometry
+
+	// glyphs are packed left to right onto shelves as tall as their tallest one
+	int shelfX = 0;
+	int shelfY = 0;
+	int shelfHeight = 0;
+
+	const Glyph* glyph(CachedFont* font, const char* bytes, size_t length);
+	void reset();
+
+#ifdef TEXT_RENDERER_GEOMETRY
+	std::vector<SDL_Vertex> vertices;
+	std::vector<int> indices;
+	void drawEach();
+#endif
+};
@@ -0,0 +1,200 @@
+#include "TileCache.hpp"
+#include "../libs/chesto/src/RootDisplay.hpp"
+#include "Utils.hpp"
+
+#include <climits>
+#include <iostream>
+
+#define TILE_BYTES (TILE_SIZE * TILE_SIZE * 4)
+
+TileCache& TileCache::getInstance()
+{
+	static TileCache instance;
+	return instance;
+}
+
+// rounding down, for tiles above or left of the document's origin
+static int floorDiv(int value, int size)
+{
+	return value >= 0 ? value / size : -((size - 1 - value) / size);
+}
+
+static SDL_Texture* createTexture()
+{
+	auto renderer = RootDisplay::mainDisplay->renderer;
+	auto texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+		SDL_TEXTUREACCESS_TARGET, TILE_SIZE, TILE_SIZE);
+
+	// tiles are opaque (see rasterize), no need to blend them
+	if (texture != nullptr)
+		SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+	return texture;
+}
+
+SDL_Texture* TileCache::freeTexture(bool ahead)
+{
+	if ((tiles.size() + 1) * TILE_BYTES <= TILE_CACHE_MEMORY_LIMIT)
+		return createTexture();
+
+	// full, take over the least recently used tile that isn't on screen
+	auto oldest = tiles.end();
+	for (auto it = tiles.begin(); it != tiles.end(); ++it)
+	{
+		if (it->second.lastUse < frame && (oldest == tiles.end() || it->second.lastUse < oldest->second.lastUse))
+			oldest = it;
+	}
+
+	if (oldest == tiles.end())
+	{
+		// all of them are, go over the limit rather than leave a hole in the
+		// page (but not just to get ahead)
+		return ahead ? nullptr : createTexture();
+	}
+
+	auto texture = oldest->second.texture;
+	tiles.erase(oldest);
+	evictions++;
+	return texture;
+}
+
+void TileCache::rasterize(DisplayList& list, int col, int row, SDL_Texture* texture)
+{
+	auto renderer = RootDisplay::mainDisplay->renderer;
+	auto previous = SDL_GetRenderTarget(renderer);
+	Uint8 r, g, b, a;
+	SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+
+	// on the page background, which is what's under the page anyway, so the
+	// tile can just be copied over it
+	SDL_SetRenderTarget(renderer, texture);
+	auto& background = RootDisplay::mainDisplay->backgroundColor;
+	SDL_SetRenderDrawColor(renderer, background.r * 0xff, background.g * 0xff,
+		background.b * 0xff, 0xff);
+	SDL_RenderClear(renderer);
+	list.replay(-col * TILE_SIZE, -row * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+
+	SDL_SetRenderTarget(renderer, previous);
+	SDL_SetRenderDrawColor(renderer, r, g, b, a);
+}
+
+TileCache::Tile* TileCache::tileFor(DisplayList& list, int col, int row, bool ahead)
+{
+	uint64_t hash = list.tileHash(col, row);
+	if (hash == 0)
+		return nullptr; // nothing in it
+
+	auto key = TileKey(&list, col, row);
+	auto existing = tiles.find(key);
+	if (existing != tiles.end() && existing->second.hash == hash)
+	{
+		existing->second.lastUse = frame;
+		if (!ahead)
+			hits++;
+		return &existing->second;
+	}
+
+	// drawn from an older recording and something in it changed since, it can
+	// be drawn again in place
+	SDL_Texture* texture = nullptr;
+	if (existing != tiles.end())
+	{
+		texture = existing->second.texture;
+		damaged++;
+	}
+	else
+	{
+		texture = freeTexture(ahead);
+		if (texture == nullptr)
+			return nullptr;
+	}
+
+	rasterize(list, col, row, texture);
+	if (ahead)
+		prefetched++;
+	else
+		misses++;
+
+	auto& tile = tiles[key];
+	tile.texture = texture;
+	tile.hash = hash;
+	tile.lastUse = frame;
+	return &tile;
+}
+
+bool TileCache::composite(DisplayList& list, int x, int y, int width, int height)
+{
+	if (unsupported)
+		return false;
+
+	auto renderer = RootDisplay::mainDisplay->renderer;
+	if (!SDL_RenderTargetSupported(renderer))
+	{
+		std::cout << "[TileCache] No render targets, drawing pages directly" << std::endl;
+		unsupported = true;
+		return false;
+	}
+	frame++;
+
+	// which way it's going, to get ahead of it (the page moves up as it
+	// scrolls down)
+	if (&list == lastList && y != lastY)
+		direction = y < lastY ? 1 : -1;
+	lastList = &list;
+	lastY = y;
+
+	// the tiles on screen
+	int firstCol = floorDiv(-x, TILE_SIZE), lastCol = floorDiv(width - x - 1, TILE_SIZE);
+	int firstRow = floorDiv(-y, TILE_SIZE), lastRow = floorDiv(height - y - 1, TILE_SIZE);
+	for (int row = firstRow; row <= lastRow; row++)
+	{
+		for (int col = firstCol; col <= lastCol; col++)
+		{
+			auto tile = tileFor(list, col, row, false);
+			if (tile == nullptr)
+				continue;
+
+			SDL_Rect dest = { x + col * TILE_SIZE, y + row * TILE_SIZE, TILE_SIZE, TILE_SIZE };
+			SDL_RenderCopy(renderer, tile->texture, NULL, &dest);
+		}
+	}
+
+	// and the row that's coming up next
+	int aheadRow = direction > 0 ? lastRow + 1 : firstRow - 1;
+	int start = prefetched;
+	for (int col = firstCol; col <= lastCol && prefetched - start < TILE_PREFETCH_PER_FRAME; col++)
+		tileFor(list, col, aheadRow, true);
+
+	return true;
+}
+
+void TileCache::drop(const DisplayList* list)
+{
+	auto it = tiles.lower_bound(TileKey(list, INT_MIN, INT_MIN));
+	while (it != tiles.end() && std::get<0>(it->first) == list)
+	{
+		SDL_DestroyTexture(it->second.texture);
+		it = tiles.erase(it);
+	}
+
+	if (lastList == list)
+		lastList = nullptr;
+}
+
+void TileCache::logStats()
+{
+	if (hits + misses == 0)
+		return;
+
+	std::cout << "[TileCache] " << hits * 100 / (hits + misses) << "% hit rate ("
+			  << hits << " hit" << plural(hits) << ", " << misses << " miss"
+			  << (misses == 1 ? "" : "es") << "), " << prefetched << " prefetched, "
+			  << damaged << " damaged, " << evictions << " evicted, "
+			  << tiles.size() * TILE_BYTES / 1024 << "KB in " << tiles.size()
+			  << " tile" << plural((int)tiles.size()) << std::endl;
+
+	hits = 0;
+	misses = 0;
+	prefetched = 0;
+	damaged = 0;
+	evictions = 0;
+}
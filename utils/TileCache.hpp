@@ -0,0 +1,74 @@
+#pragma once
+
+#include "DisplayList.hpp"
+#include <cstdint>
+#include <map>
+#include <tuple>
+
+// pages are rasterized into square tiles this big (in document pixels)
+#define TILE_SIZE 256
+
+// how much the tiles of every page can take up together, before the least
+// recently used ones are reused (a tile is TILE_SIZE^2 * 4 bytes)
+#ifdef _3DS
+#define TILE_CACHE_MEMORY_LIMIT 0x300000
+#else
+#define TILE_CACHE_MEMORY_LIMIT 0x1000000
+#endif
+
+// tiles past the edge of the viewport (in the direction it's scrolling) to
+// rasterize ahead of time, at most this many per frame
+#define TILE_PREFETCH_PER_FRAME 2
+
+// Draws pages from tiles that were rasterized (by replaying the display list
+// into a render target) once, instead of replaying what's visible every frame,
+// so scrolling is one copy per tile on screen. A tile is only drawn again
+// when the hash of what's in it changes with a new recording, and tiles with
+// nothing in them are skipped (the page background shows through). Images are
+// elements drawn on top of the page, so they never damage a tile.
+// Main thread only.
+class TileCache
+{
+public:
+	static TileCache& getInstance();
+
+	// draw list with the document scrolled to x, y into the width x height
+	// viewport, false if there are no render targets (and it should be
+	// replayed directly)
+	bool composite(DisplayList& list, int x, int y, int width, int height);
+
+	// forget every tile of list (it's going away)
+	void drop(const DisplayList* list);
+
+	// counters for debugging
+	int hits = 0;
+	int misses = 0;
+	int prefetched = 0;
+	int damaged = 0; // drawn again because their content changed
+	int evictions = 0;
+	void logStats();
+
+private:
+	TileCache() = default;
+
+	struct Tile
+	{
+		SDL_Texture* texture = nullptr;
+		uint64_t hash = 0; // of what it was drawn from
+		uint64_t lastUse = 0;
+	};
+	typedef std::tuple<const DisplayList*, int, int> TileKey; // list, column, row
+	std::map<TileKey, Tile> tiles;
+	uint64_t frame = 0;
+	bool unsupported = false;
+
+	// where the last page drawn was scrolled, to prefetch in the direction it's
+	// going
+	const DisplayList* lastList = nullptr;
+	int lastY = 0;
+	int direction = 1; // 1 is down the page, -1 up
+
+	Tile* tileFor(DisplayList& list, int col, int row, bool ahead);
+	SDL_Texture* freeTexture(bool ahead);
+	void rasterize(DisplayList& list, int col, int row, SDL_Texture* texture);
+};
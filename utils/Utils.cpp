@@ -36,6 +36,8 @@
 #include <map>
 #include <regex>
 
+#include "ConnectionPool.hpp"
+#include "NetworkWorker.hpp"
 #include "Utils.hpp"
 
 // resinfs support, if present
@@ -45,15 +47,8 @@
 #define RAMFS "resin/"
 #endif
 
-#define BUF_SIZE 0x800000 // 8MB.
-
 int (*networking_callback)(void*, double, double, double, double);
 
-// reference to the curl handle so that we can re-use the connection
-#ifndef NETWORK_MOCK
-CURL* curl = NULL;
-#endif
-
 #define SOCU_ALIGN 0x1000
 #define SOCU_BUFFERSIZE 0x100000
 
@@ -128,40 +123,27 @@ int sockopt_callback(void* clientp, curl_socket_t curlfd,
 #endif
 
 #ifndef NETWORK_MOCK
+// the CA bundle, read once by init_networking instead of by every connection
+static std::string caBundle;
+
 void setPlatformCurlFlags(CURL* c)
 {
 	// // from
 	// https://github.com/GaryOderNichts/wiiu-examples/blob/main/curl-https/romfs/cacert.pem
-	curl_easy_setopt(c, CURLOPT_CAINFO, RAMFS "res/cacert.pem");
-
-	curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, sockopt_callback);
-}
-#endif
-
-static size_t MemoryWriteCallback(void* contents, size_t size, size_t nmemb,
-	void* userp)
-{
-	((std::string*)userp)->append((char*)contents, size * nmemb);
-	return size * nmemb;
-}
-
-static size_t DiskWriteCallback(void* contents, size_t size, size_t num_files,
-	void* userp)
-{
-	ntwrk_struct_t* data_struct = (ntwrk_struct_t*)userp;
-	size_t realsize = size * num_files;
-
-	if (realsize + data_struct->offset >= data_struct->data_size)
+#if LIBCURL_VERSION_NUM >= 0x074d00
+	if (!caBundle.empty())
 	{
-		fwrite(data_struct->data, data_struct->offset, 1, data_struct->out);
-		data_struct->offset = 0;
+		// curl copies nothing, the bundle lives as long as the process
+		curl_blob blob = { (void*)caBundle.data(), caBundle.size(), CURL_BLOB_NOCOPY };
+		curl_easy_setopt(c, CURLOPT_CAINFO_BLOB, &blob);
 	}
+	else
+#endif
+		curl_easy_setopt(c, CURLOPT_CAINFO, RAMFS "res/cacert.pem");
 
-	memcpy(&data_struct->data[data_struct->offset], contents, realsize);
-	data_struct->offset += realsize;
-	data_struct->data[data_struct->offset] = 0;
-	return realsize;
+	curl_easy_setopt(c, CURLOPT_SOCKOPTFUNCTION, sockopt_callback);
 }
+#endif
 
 // record the headers into a map
 size_t header_callback(char* buffer, size_t size, size_t nitems,
@@ -180,11 +162,16 @@ size_t header_callback(char* buffer, size_t size, size_t nitems,
 	std::string name = header.substr(0, pos);
 	std::string value = header.substr(pos + 1);
 
-	// Remove whitespace
+	// Remove whitespace (including the trailing CRLF)
 	value.erase(value.begin(),
 		std::find_if(value.begin(), value.end(),
 			[](int ch)
 			{ return !std::isspace(ch); }));
+	value.erase(std::find_if(value.rbegin(), value.rend(),
+					[](int ch)
+					{ return !std::isspace(ch); })
+					.base(),
+		value.end());
 	// https://stackoverflow.com/a/313990/4953343
 	std::transform(name.begin(), name.end(), name.begin(),
 		[](unsigned char c)
@@ -194,99 +181,6 @@ size_t header_callback(char* buffer, size_t size, size_t nitems,
 	return nitems * size;
 }
 
-// https://gist.github.com/alghanmi/c5d7b761b2c9ab199157
-// if data_struct is specified, file will go straight to disk as it downloads
-bool downloadFileCommon(std::string path, std::string* buffer = NULL,
-	ntwrk_struct_t* data_struct = NULL,
-	int* http_code = NULL,
-	std::map<std::string, std::string>* headerResp = NULL)
-{
-#ifndef NETWORK_MOCK
-	CURLcode res;
-
-	if (!curl)
-		return false;
-
-	setPlatformCurlFlags(curl);
-
-	curl_easy_setopt(curl, CURLOPT_URL, path.c_str());
-	curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, networking_callback);
-	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
-
-	// set user agent
-	const char* userAgent = "Mozilla/5.0 (Generic; Chesto) litehtml/0.8 (KHTML, "
-							"like Gecko) Broccolini/0.0";
-
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, userAgent);
-
-	bool skipDisk = data_struct == NULL;
-
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION,
-		skipDisk ? MemoryWriteCallback : DiskWriteCallback);
-
-	// get header info as map
-	curl_slist* curlHeaders = NULL;
-	if (headerResp != NULL)
-	{
-		// iterate through each header from the curl resp
-		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
-		curl_easy_setopt(curl, CURLOPT_HEADERDATA, headerResp);
-	}
-
-	if (skipDisk)
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, buffer);
-	else
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, data_struct);
-
-	bool ret = curl_easy_perform(curl) == CURLE_OK;
-	// get status code info
-	if (http_code != NULL)
-	{
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, http_code);
-	}
-
-	return ret;
-#else
-	return true;
-#endif
-}
-
-bool downloadFileToMemory(std::string path, std::string* buffer, int* httpCode,
-	std::map<std::string, std::string>* headerResp)
-{
-	return downloadFileCommon(path, buffer, NULL, httpCode, headerResp);
-}
-
-bool downloadFileToDisk(std::string remote_path, std::string local_path)
-{
-	FILE* out_file = fopen(local_path.c_str(), "wb");
-	if (!out_file)
-		return false;
-
-	uint8_t* buf = (uint8_t*)malloc(BUF_SIZE); // 8MB.
-	if (buf == NULL)
-	{
-		fclose(out_file);
-		return false;
-	}
-
-	ntwrk_struct_t data_struct = { buf, BUF_SIZE, 0, out_file };
-
-	if (!downloadFileCommon(remote_path, NULL, &data_struct))
-	{
-		free(data_struct.data);
-		fclose(data_struct.out);
-		return false;
-	}
-
-	// write remaning data to file before free.
-	fwrite(data_struct.data, data_struct.offset, 1, data_struct.out);
-	free(data_struct.data);
-	fclose(data_struct.out);
-
-	return true;
-}
-
 const char* plural(int amount) { return (amount == 1) ? "" : "s"; }
 
 const std::string dir_name(std::string file_path)
@@ -325,10 +219,11 @@ int init_networking()
 
 #ifndef NETWORK_MOCK
 	curl_global_init(CURL_GLOBAL_ALL);
+	caBundle = readFile(RAMFS "res/cacert.pem");
 
-	// init our curl handle
-	curl = curl_easy_init();
-
+	// page loads happen on their own thread, all sharing one connection pool
+	ConnectionPool::getInstance().init();
+	NetworkWorker::getInstance().start();
 #endif
 	return 1;
 }
@@ -336,7 +231,8 @@ int init_networking()
 int deinit_networking()
 {
 #ifndef NETWORK_MOCK
-	curl_easy_cleanup(curl);
+	NetworkWorker::getInstance().stop();
+	ConnectionPool::getInstance().cleanup();
 	curl_global_cleanup();
 #endif
 
@@ -494,6 +390,94 @@ std::string just_domain_from_url(const std::string& url)
 	return "n/a";
 }
 
+UrlBase urlBaseOf(const std::string& pageUrl)
+{
+	UrlBase base;
+	std::string url = pageUrl;
+
+	// we assume we have a proper protocol set
+	auto protoPos = url.find("://") + 3;
+
+	// extract base url from full URL
+	auto endPos = url.find_last_of("/");
+	base.url = url.substr(0, protoPos) + url.substr(protoPos, endPos);
+	if (endPos < protoPos)
+	{
+		// just use the URL as is, with a trailing slash
+		base.url = url;
+	}
+
+	// extract base domain from full URL
+	url += "/";
+	base.protocol = url.substr(0, url.find("://"));
+	std::string domain = url.substr(url.find("://") + 3);
+
+	auto endingSlashPos = domain.find("/");
+	if (endingSlashPos != std::string::npos)
+	{
+		domain = domain.substr(0, endingSlashPos);
+	}
+	base.domain = base.protocol + "://" + domain;
+	return base;
+}
+
+std::string resolveUrl(const UrlBase& base, const char* src, const char* baseurl)
+{
+	std::stringstream ss;
+	std::string url;
+
+	if (strncmp(src, "https://", 8) == 0 || strncmp(src, "http://", 7) == 0 || strncmp(src, "data:", 5) == 0 || strncmp(src, "mailto:", 7) == 0 || strncmp(src, "javascript:", 11) == 0 || strncmp(src, "special:", 8) == 0 || strncmp(src, "localhost", 9) == 0 || strncmp(src, "file://", 7) == 0)
+	{
+		// this is a https/http/data/mailto/js uri, just use it directly
+		ss << src;
+		url = ss.str();
+	}
+	else if (baseurl == 0 || *baseurl == '\0')
+	{
+		if (strlen(src) > 0 && src[0] == '/')
+		{
+			if (strlen(src) > 1 && src[1] == '/')
+			{
+				// this is a starting double "//" url, just take the protocol
+				ss << base.protocol << ":" << src;
+			}
+			else
+			{
+				// this is a starting single "/" url, just take the domain
+				ss << base.domain << src;
+			}
+		}
+		else
+		{
+			// this is a relative url, take the base url
+			std::string curUrl = base.url;
+			// strip out the GET parameters (TODO: does this affect the baseurl
+			// elsewhere?)
+			auto questionMark = curUrl.find("?");
+			if (questionMark != std::string::npos)
+			{
+				curUrl = curUrl.substr(0, questionMark);
+			}
+			// same for the hash
+			auto hash = curUrl.find("#");
+			if (hash != std::string::npos)
+			{
+				curUrl = curUrl.substr(0, hash);
+			}
+			// make sure there's a trailing slash
+			if (curUrl[curUrl.length() - 1] != '/')
+			{
+				curUrl += "/";
+			}
+			ss << curUrl << src;
+		}
+
+		url = ss.str();
+	}
+
+	return url;
+}
+
 // https://stackoverflow.com/a/56891830/4953343
 std::string myReplace(std::string str, std::string substr1,
 	std::string substr2)
@@ -529,6 +513,17 @@ std::string readFile(const std::string& path)
 	return content;
 }
 
+uint64_t hashString(const std::string& data)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (unsigned char c : data)
+	{
+		hash ^= c;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
 void parseJSON(const std::string& json, std::map<std::string, void*>& map)
 {
 	// TODO: Remove this function and update callers to use JSEngine directly
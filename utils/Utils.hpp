@@ -1,3 +1,5 @@
+#pragma once
+
 #ifndef NETWORK_MOCK
 #include <curl/curl.h>
 #include <curl/easy.h>
@@ -8,15 +10,6 @@
 #include <stdio.h>
 #include <string>
 
-// the struct to be passed in the write function.
-typedef struct
-{
-	uint8_t* data;
-	size_t data_size;
-	u_int64_t offset;
-	FILE* out;
-} ntwrk_struct_t;
-
 #define STATUS_DOWNLOADING 0
 #define STATUS_INSTALLING 1
 #define STATUS_REMOVING 2
@@ -29,16 +22,23 @@ bool CreateSubfolder(char* cstringpath);
 
 // networking stuff
 int init_networking();
-bool downloadFileToMemory(std::string path, std::string* buffer,
-	int* httpCode = NULL,
-	std::map<std::string, std::string>* headerResp = NULL); // writes to disk in BUF_SIZE chunks.
-bool downloadFileToDisk(std::string remote_path,
-	std::string local_path); // saves file to local_path.
+// (every fetch goes through the NetworkWorker, and files to save through the
+// DownloadManager, both off the main thread)
 
 #ifndef NETWORK_MOCK
 void setPlatformCurlFlags(CURL* c);
 #endif
 
+#define USER_AGENT "Mozilla/5.0 (Generic; Chesto) litehtml/0.8 (KHTML, " \
+				   "like Gecko) Broccolini/0.0"
+
+// an empty Accept-Encoding lets curl offer every encoding it was built with
+// (gzip, deflate, and br/zstd where available) and decode them as they stream
+#define ACCEPT_ENCODING ""
+
+// curl header callback, records headers into a std::map<std::string, std::string>
+size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata);
+
 // callback for networking progress
 // if set, will be invoked during the download
 extern int (*networking_callback)(void*, double, double, double, double);
@@ -55,8 +55,23 @@ bool compareLen(const std::string& a, const std::string& b);
 std::string base64_decode(const std::string_view encoded_string);
 std::string base64_encode(const std::string_view bytes_to_encode);
 std::string just_domain_from_url(const std::string& url);
+
+// a page's url broken down the way the links on it are resolved against
+struct UrlBase
+{
+	std::string url;	  // eg. https://site.com/path/to/page
+	std::string domain;	  // eg. https://site.com
+	std::string protocol; // eg. https
+};
+UrlBase urlBaseOf(const std::string& pageUrl);
+
+// convert the url component according to URI rules (relative to baseurl
+// isn't supported, those come back empty)
+std::string resolveUrl(const UrlBase& base, const char* src,
+	const char* baseurl = nullptr);
 std::string myReplace(std::string str, std::string substr1,
 	std::string substr2);
 bool writeFile(const std::string& path, const std::string& content);
 std::string readFile(const std::string& path);
+uint64_t hashString(const std::string& data); // 64-bit FNV-1a
 void parseJSON(const std::string& json, std::map<std::string, void*>& map);
\ No newline at end of file